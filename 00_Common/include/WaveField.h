@@ -0,0 +1,210 @@
+#pragma once
+#include <cinder/CinderMath.h>
+#include <cinder/Thread.h>
+#include <emmintrin.h>
+#include <vector>
+
+// CPU version of the wave BoxApp's vertex shader and MeshApp's wave
+// pass apply to each point. Positions are stored as separate X, Y, 
+// and Z arrays so four points are displaced at a time with SSE. 
+// Large batches are split across every core. No GL context is 
+// needed, so this can be used to find bounds, pick boxes, or check
+// the GPU's output. It's header only, so an app only needs this 
+// folder on its include path.
+class WaveField
+{
+
+public:
+
+	WaveField();
+
+	// Displaces "count" points. Output arrays may be the same 
+	// as the input arrays.
+	void displace(const float * x, const float * y, const float * z, float * outX, float * outY, float * outZ, size_t count) const;
+
+	// Fills arrays with the grid's undisplaced positions, 
+	// centered on the origin. BoxApp's points are one unit 
+	// apart and MeshApp's are two.
+	static void fillGrid(int32_t width, int32_t height, float * x, float * y, float * z, float spacing = 1.0f);
+
+	// Matches the vertex shader's uniforms
+	void setWave(float amp, float phase, float scale, float speed, float width);
+
+	// Four sines at once. Accurate to about one float ULP 
+	// after range reduction.
+	static __m128 sin(__m128 x);
+
+private:
+
+	// Displaces points in [begin, end)
+	void displaceRange(const float * x, const float * y, const float * z, float * outX, float * outY, float * outZ, size_t begin, size_t end) const;
+
+	// Properties
+	float mAmp;
+	float mPhase;
+	float mScale;
+	float mSpeed;
+	float mWidth;
+
+};
+
+// Constructor
+inline WaveField::WaveField()
+{
+	mAmp = 0.0f;
+	mPhase = 0.0f;
+	mScale = 1.0f;
+	mSpeed = 0.0f;
+	mWidth = 0.0f;
+}
+
+// Displaces points using every core
+inline void WaveField::displace(const float * x, const float * y, const float * z, float * outX, float * outY, float * outZ, size_t count) const
+{
+
+	// Small batches aren't worth the cost of starting threads
+	size_t threadCount = ci::math<size_t>::max(std::thread::hardware_concurrency(), 1);
+	if (count < 65536 || threadCount == 1)
+	{
+		displaceRange(x, y, z, outX, outY, outZ, 0, count);
+		return;
+	}
+
+	// Give each thread an equal slice, rounded to a multiple
+	// of four. The calling thread takes the last slice.
+	size_t sliceSize = ((count + threadCount - 1) / threadCount + 3) & ~(size_t)3;
+	std::vector<std::shared_ptr<std::thread> > threads;
+	for (size_t begin = 0; begin + sliceSize < count; begin += sliceSize)
+		threads.push_back(std::shared_ptr<std::thread>(new std::thread(std::bind(& WaveField::displaceRange, this, x, y, z, outX, outY, outZ, begin, begin + sliceSize))));
+	displaceRange(x, y, z, outX, outY, outZ, threads.size() * sliceSize, count);
+
+	// Wait for the other slices to finish
+	for (std::vector<std::shared_ptr<std::thread> >::iterator threadIt = threads.begin(); threadIt != threads.end(); ++threadIt)
+		(* threadIt)->join();
+
+}
+
+// Displaces points in [begin, end), four at a time
+inline void WaveField::displaceRange(const float * x, const float * y, const float * z, float * outX, float * outY, float * outZ, size_t begin, size_t end) const
+{
+
+	// Per-batch constants
+	__m128 amp = _mm_set1_ps(mAmp * mScale);
+	__m128 phase = _mm_set1_ps(mPhase * mSpeed);
+	__m128 scale = _mm_set1_ps(mScale);
+	__m128 width = _mm_set1_ps(mWidth);
+
+	// Displace four points at a time. The last few points are 
+	// copied into a padded block so they take the same path.
+	for (size_t i = begin; i < end; i += 4)
+	{
+
+		// Load
+		size_t count = ci::math<size_t>::min(end - i, 4);
+		__m128 px;
+		__m128 py;
+		__m128 pz;
+		if (count == 4)
+		{
+			px = _mm_loadu_ps(x + i);
+			py = _mm_loadu_ps(y + i);
+			pz = _mm_loadu_ps(z + i);
+		}
+		else
+		{
+			float block[3][4] = { { 0.0f } };
+			for (size_t j = 0; j < count; j++)
+			{
+				block[0][j] = x[i + j];
+				block[1][j] = y[i + j];
+				block[2][j] = z[i + j];
+			}
+			px = _mm_loadu_ps(block[0]);
+			py = _mm_loadu_ps(block[1]);
+			pz = _mm_loadu_ps(block[2]);
+		}
+
+		// Same math as the vertex shader
+		__m128 wave = _mm_mul_ps(sin(_mm_add_ps(phase, _mm_mul_ps(px, width))), amp);
+		px = _mm_mul_ps(scale, px);
+		py = _mm_add_ps(_mm_mul_ps(scale, py), wave);
+		pz = _mm_sub_ps(_mm_mul_ps(scale, pz), wave);
+
+		// Store
+		if (count == 4)
+		{
+			_mm_storeu_ps(outX + i, px);
+			_mm_storeu_ps(outY + i, py);
+			_mm_storeu_ps(outZ + i, pz);
+		}
+		else
+		{
+			float block[3][4];
+			_mm_storeu_ps(block[0], px);
+			_mm_storeu_ps(block[1], py);
+			_mm_storeu_ps(block[2], pz);
+			for (size_t j = 0; j < count; j++)
+			{
+				outX[i + j] = block[0][j];
+				outY[i + j] = block[1][j];
+				outZ[i + j] = block[2][j];
+			}
+		}
+
+	}
+
+}
+
+// Grid positions, numbered left to right, top to bottom
+inline void WaveField::fillGrid(int32_t width, int32_t height, float * x, float * y, float * z, float spacing)
+{
+	for (int32_t row = 0; row < height; row++)
+		for (int32_t column = 0; column < width; column++)
+		{
+			size_t i = (size_t)row * (size_t)width + (size_t)column;
+			x[i] = ((float)column - (float)width * 0.5f) * spacing;
+			y[i] = ((float)row - (float)height * 0.5f) * spacing;
+			z[i] = 0.0f;
+		}
+}
+
+// Set wave parameters
+inline void WaveField::setWave(float amp, float phase, float scale, float speed, float width)
+{
+	mAmp = amp;
+	mPhase = phase;
+	mScale = scale;
+	mSpeed = speed;
+	mWidth = width;
+}
+
+// Reduces to [-pi, pi], folds to [-pi/2, pi/2], then 
+// evaluates an odd polynomial through x^11
+inline __m128 WaveField::sin(__m128 x)
+{
+
+	// Subtract the nearest multiple of two pi. Two pi is split 
+	// in two parts so the reduction keeps its precision.
+	__m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.15915494309f))));
+	x = _mm_sub_ps(x, _mm_mul_ps(turns, _mm_set1_ps(6.28125f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(turns, _mm_set1_ps(1.9353071795864769e-3f)));
+
+	// sin(x) = sin(pi - x), so fold the outer quarters inward
+	__m128 halfPi = _mm_set1_ps(1.57079632679f);
+	__m128 pi = _mm_set1_ps(3.14159265359f);
+	__m128 upper = _mm_cmpgt_ps(x, halfPi);
+	__m128 lower = _mm_cmplt_ps(x, _mm_sub_ps(_mm_setzero_ps(), halfPi));
+	x = _mm_or_ps(_mm_andnot_ps(upper, x), _mm_and_ps(upper, _mm_sub_ps(pi, x)));
+	x = _mm_or_ps(_mm_andnot_ps(lower, x), _mm_and_ps(lower, _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), pi), x)));
+
+	// Taylor series in x^2
+	__m128 x2 = _mm_mul_ps(x, x);
+	__m128 y = _mm_set1_ps(-2.5052108385e-8f);
+	y = _mm_add_ps(_mm_mul_ps(y, x2), _mm_set1_ps(2.7557319224e-6f));
+	y = _mm_add_ps(_mm_mul_ps(y, x2), _mm_set1_ps(-1.9841269841e-4f));
+	y = _mm_add_ps(_mm_mul_ps(y, x2), _mm_set1_ps(8.3333333333e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x2), _mm_set1_ps(-1.6666666667e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x2), _mm_set1_ps(1.0f));
+	return _mm_mul_ps(y, x);
+
+}
@@ -5,3 +5,5 @@
 #define RES_SHADER_FRAG		CINDER_RESOURCE(../resources/, frag.glsl, 128, GLSL)
 #define RES_SHADER_GEOM		CINDER_RESOURCE(../resources/, geom.glsl, 129, GLSL)
 #define RES_SHADER_VERT		CINDER_RESOURCE(../resources/, vert.glsl, 130, GLSL)
+#define RES_SHADER_SDF_FRAG		CINDER_RESOURCE(../resources/, sdf_frag.glsl, 131, GLSL)
+#define RES_SHADER_SDF_GEOM		CINDER_RESOURCE(../resources/, sdf_geom.glsl, 132, GLSL)
@@ -1,10 +1,13 @@
 #version 120
 
+// Input attributes
+varying vec4 colorOut;
+
 // Kernel
 void main(void)
 {
 
-	// Set to white
-	gl_FragColor = vec4(1.0, 1.0, 1.0, 1.0);
+	// Use the shape's color
+	gl_FragColor = colorOut;
 
 }
@@ -9,10 +9,33 @@ const int SHAPE_TRIANGLE = 0;
 
 // Uniforms
 uniform float aspect;
-uniform int shape;
 uniform float size;
 uniform bool transform;
 
+// Input attributes
+varying in vec4 color[1];
+varying in vec2 params[1];
+varying in float type[1];
+
+// Output attributes
+varying vec4 colorOut;
+
+// Shape properties for this point
+float radius;
+float rotation;
+
+// Adds a vertex at an angle around the point
+void addVertex(float angle)
+{
+
+	// Rotate the angle by the shape's rotation, then 
+	// offset from the point's position
+	colorOut = color[0];
+	gl_Position = gl_PositionIn[0] + vec4(cos(angle + rotation) * radius, sin(angle + rotation) * radius * aspect, 0.0, 0.0);
+	EmitVertex();
+
+}
+
 // Kernel
 void main(void)
 {
@@ -21,6 +44,13 @@ void main(void)
 	if (transform)
 	{
 
+		// Each point carries its own shape, size, and rotation.
+		// The size attribute scales the global "size" uniform
+		// and rotation is a fraction of a full turn.
+		int shape = int(type[0] + 0.5);
+		radius = size * params[0].x;
+		rotation = params[0].y * 6.283185306;
+
 		// Note that we use the window's aspect ratio
 		// on all Y values. This is because we're doing 2D 
 		// drawing in a 3D space. Once you move into pure 3D. 
@@ -30,18 +60,14 @@ void main(void)
 		if (shape == SHAPE_TRIANGLE)
 		{
 
-
 			// To draw a triangle, we add the size times the cos 
 			// and sin of each angle to the original position.
 			// After each point is set, we call EmitVertex() to
 			// add a vertex to the geometry. Be sure to draw 
 			// counter-clockwise.
-			gl_Position = gl_PositionIn[0] + vec4(cos(radians(270.0)) * size, sin(radians(270.0)) * size * aspect, 0.0, 0.0);
-			EmitVertex();
-			gl_Position = gl_PositionIn[0] + vec4(cos(radians(150.0)) * size, sin(radians(150.0)) * size * aspect, 0.0, 0.0);
-			EmitVertex();
-			gl_Position = gl_PositionIn[0] + vec4(cos(radians(30.0)) * size, sin(radians(30.0)) * size * aspect, 0.0, 0.0);
-			EmitVertex();
+			addVertex(radians(270.0));
+			addVertex(radians(150.0));
+			addVertex(radians(30.0));
 			
 			// Call EndPrimitive() to close the shape. Note that this 
 			// is not needed if you are only drawing one primitive, since 
@@ -51,31 +77,20 @@ void main(void)
 		} else if (shape == SHAPE_SQUARE) {
 
 			// To draw a square, we will draw two triangles, just like 
-			// above. The two triangles will share vertices, so we'll define
-			// the vertices in advance.
-			vec4 vert0 = vec4(cos(radians(315.0)) * size, sin(radians(315.0)) * size * aspect, 0.0, 0.0);
-			vec4 vert1 = vec4(cos(radians(225.0)) * size, sin(radians(225.0)) * size * aspect, 0.0, 0.0);
-			vec4 vert2 = vec4(cos(radians(135.0)) * size, sin(radians(135.0)) * size * aspect, 0.0, 0.0);
-			vec4 vert3 = vec4(cos(radians(45.0)) * size, sin(radians(45.0)) * size * aspect, 0.0, 0.0);
+			// above. The two triangles share an edge.
 
 			// Draw the left triangle
-			gl_Position = gl_PositionIn[0] + vert0;
-			EmitVertex();
-			gl_Position = gl_PositionIn[0] + vert1;
-			EmitVertex();
-			gl_Position = gl_PositionIn[0] + vert3;
-			EmitVertex();
+			addVertex(radians(315.0));
+			addVertex(radians(225.0));
+			addVertex(radians(45.0));
 
 			// Close this triangle
 			EndPrimitive();
 			
 			// And now the right one
-			gl_Position = gl_PositionIn[0] + vert3;
-			EmitVertex();
-			gl_Position = gl_PositionIn[0] + vert1;
-			EmitVertex();
-			gl_Position = gl_PositionIn[0] + vert2;
-			EmitVertex();
+			addVertex(radians(45.0));
+			addVertex(radians(225.0));
+			addVertex(radians(135.0));
 
 			// Close the second triangle to form a quad
 			EndPrimitive();
@@ -90,12 +105,11 @@ void main(void)
 			{
 
 				// Draw a triangle to form a wedge of the circle
-				gl_Position = gl_PositionIn[0] + vec4(cos(theta) * size, sin(theta) * size * aspect, 0.0, 0.0);
-				EmitVertex();
+				addVertex(theta);
+				colorOut = color[0];
 				gl_Position = gl_PositionIn[0];
 				EmitVertex();
-				gl_Position = gl_PositionIn[0] + vec4(cos(theta + delta) * size, sin(theta + delta) * size * aspect, 0.0, 0.0);
-				EmitVertex();
+				addVertex(theta + delta);
 				EndPrimitive();
 
 			}
@@ -107,6 +121,7 @@ void main(void)
 	{
 
 		// Pass-thru
+		colorOut = vec4(1.0, 1.0, 1.0, 1.0);
 		gl_Position = gl_PositionIn[0];
 		EmitVertex();
 		EndPrimitive();
@@ -0,0 +1,58 @@
+#version 120
+
+// Constants to match those in CPP
+const int SHAPE_CIRCLE = 2;
+const int SHAPE_SQUARE = 1;
+const int SHAPE_TRIANGLE = 0;
+
+// Input attributes
+varying vec4 colorOut;
+varying vec2 localOut;
+varying float shapeOut;
+
+// Kernel
+void main(void)
+{
+
+	// Find the signed distance from this fragment to the 
+	// shape's edge, in units of the shape's radius. Negative
+	// distances are inside the shape. The shapes match the 
+	// vertices geom.glsl builds.
+	float dist = 0.0;
+	int shape = int(shapeOut + 0.5);
+	if (shape == SHAPE_TRIANGLE)
+	{
+
+		// The triangle's corners are on the unit circle at 270, 
+		// 150, and 30 degrees, so each edge is half a radius from 
+		// the center. Take the farthest distance past any edge.
+		dist = max(max(
+			dot(localOut, vec2(0.0, 1.0)), 
+			dot(localOut, vec2(0.866025, -0.5))), 
+			dot(localOut, vec2(-0.866025, -0.5))) - 0.5;
+
+	} else if (shape == SHAPE_SQUARE) {
+
+		// The square's corners are on the unit circle at 45 degree 
+		// angles, so its half width is cos(45)
+		vec2 edge = abs(localOut) - vec2(0.707107);
+		dist = length(max(edge, 0.0)) + min(max(edge.x, edge.y), 0.0);
+
+	} else {
+
+		// Circle
+		dist = length(localOut) - 1.0;
+
+	}
+
+	// Turn the distance into coverage. fwidth() tells us how
+	// much the distance changes across one pixel, so the edge
+	// is always blended over a single pixel no matter the size.
+	float coverage = clamp(0.5 - dist / max(fwidth(dist), 0.000001), 0.0, 1.0);
+	if (coverage <= 0.0)
+		discard;
+
+	// Use the shape's color
+	gl_FragColor = vec4(colorOut.rgb, colorOut.a * coverage);
+
+}
@@ -0,0 +1,66 @@
+#version 120
+#extension GL_EXT_geometry_shader4 : enable
+#extension GL_EXT_gpu_shader4 : enable 
+
+// Uniforms
+uniform float aspect;
+uniform float pixel;
+uniform float size;
+
+// Input attributes
+varying in vec4 color[1];
+varying in vec2 params[1];
+varying in float type[1];
+
+// Output attributes
+varying vec4 colorOut;
+varying vec2 localOut;
+varying float shapeOut;
+
+// Shape properties for this point
+float extent;
+float radius;
+float rotation;
+
+// Adds a quad corner. The local position is in units of the
+// shape's radius and is rotated into place on screen.
+void addVertex(vec2 local)
+{
+
+	// Assign values to output attributes
+	colorOut = color[0];
+	localOut = local * extent;
+	shapeOut = type[0];
+
+	// Rotate and offset from the point's position
+	vec2 offset = vec2(
+		localOut.x * cos(rotation) - localOut.y * sin(rotation), 
+		localOut.x * sin(rotation) + localOut.y * cos(rotation)
+		) * radius;
+	gl_Position = gl_PositionIn[0] + vec4(offset.x, offset.y * aspect, 0.0, 0.0);
+	EmitVertex();
+
+}
+
+// Kernel
+void main(void)
+{
+
+	// Read shape properties. See geom.glsl.
+	radius = size * params[0].x;
+	rotation = params[0].y * 6.283185306;
+
+	// Every shape fits in a circle of the shape's radius. We
+	// grow the quad by a pixel so anti-aliased edges aren't cut off.
+	extent = 1.0 + pixel / max(radius, 0.000001);
+
+	// Instead of building the shape out of triangles, we
+	// emit one quad and let the fragment shader evaluate
+	// the shape's distance field
+	addVertex(vec2(-1.0, -1.0));
+	addVertex(vec2( 1.0, -1.0));
+	addVertex(vec2(-1.0,  1.0));
+	addVertex(vec2( 1.0,  1.0));
+	EndPrimitive();
+
+}
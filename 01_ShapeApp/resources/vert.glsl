@@ -1,9 +1,24 @@
 #version 120
 
+// Input attributes
+attribute vec4 shapeColor;
+attribute vec2 shapeParams;
+attribute float shapeType;
+
+// Output attributes
+varying vec4 color;
+varying vec2 params;
+varying float type;
+
 // Kernel
 void main(void)
 {
 
+	// Pass shape attributes to the geometry shader
+	color = shapeColor;
+	params = shapeParams;
+	type = shapeType;
+
 	// Transform position
 	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
 
@@ -1,9 +1,11 @@
 // Includes
 #include <cinder/app/AppBasic.h>
 #include <cinder/gl/GlslProg.h>
+#include <cinder/gl/Vbo.h>
 #include <cinder/ImageIo.h>
 #include <cinder/params/Params.h>
-#include <cinder/Rand.h>
+#include <cinder/Thread.h>
+#include <cinder/Timer.h>
 #include <cinder/Utilities.h>
 #include <Resources.h>
 
@@ -13,6 +15,107 @@
  * points to shapes generated in GLSL.
  */
 
+// Each point carries its own shape attributes so a mix of
+// shapes, sizes, rotations, and colors draws in a single call.
+// Attributes are packed into a 20 byte interleaved vertex.
+struct ShapeVertex
+{
+	ci::Vec2f mPosition;	// Position in window space
+	uint8_t mColor[4];		// RGBA, normalized
+	uint16_t mSize;			// Size relative to the "size" uniform, normalized
+	uint16_t mRotation;		// Fraction of a full turn, normalized
+	uint8_t mShape;			// Shape type
+	uint8_t mPadding[3];
+};
+
+// Fills a buffer of shapes at random positions. Random values
+// come from a counter-based generator, so every point is a pure 
+// function of the seed and its index. This lets us fill the 
+// buffer from every core and still get the same field for a
+// given seed, no matter how many threads run.
+class PointField
+{
+
+public:
+
+	PointField();
+
+	// Fills "count" points. The destination may be a
+	// mapped GPU buffer.
+	void generate(ShapeVertex * points, size_t count) const;
+
+	// Fills one point, or finds just its position
+	void generatePoint(size_t index, ShapeVertex & point) const;
+	ci::Vec2f getPosition(size_t index) const;
+
+	// Points are placed between -bounds and bounds
+	void setBounds(const ci::Vec2f & bounds);
+
+	// When "mixed" is true, each point gets a random shape
+	// type below "shape", size, rotation, and color. Otherwise, 
+	// every point is a full size, white, unrotated "shape".
+	void setShape(int32_t shape, bool mixed);
+	void setSeed(uint32_t seed);
+
+	// Counter-based random number generator
+	static uint64_t random(uint32_t seed, uint64_t counter);
+
+private:
+
+	// Fills a range of points
+	void generateRange(ShapeVertex * points, size_t begin, size_t end) const;
+
+	// Properties
+	ci::Vec2f mBounds;
+	bool mMixed;
+	uint32_t mSeed;
+	int32_t mShape;
+
+};
+
+// Uniform grid over a point buffer. Points are sorted so each 
+// cell's points sit next to each other in the buffer, and each 
+// row of cells is one contiguous range. Culling to a rectangle 
+// then costs one draw range per visible row.
+class PointGrid
+{
+
+public:
+
+	PointGrid();
+
+	// Generates "count" points from "field" straight into cell 
+	// order in "sorted", which may be a mapped GPU buffer. The 
+	// same points are also written to "copy", if it isn't null.
+	void build(const PointField & field, size_t count, const ci::Rectf & bounds, int32_t columns, int32_t rows, ShapeVertex * sorted, ShapeVertex * copy);
+
+	// Finds the draw ranges for the cells overlapping "rect"
+	void cull(const ci::Rectf & rect, std::vector<GLint> & firsts, std::vector<GLsizei> & counts) const;
+
+	// Moves the point at "index" in the sorted buffer to "position".
+	// If the point changes cells, it walks to its new cell by 
+	// swapping with one point per cell boundary it crosses. The 
+	// range of indices that changed is written to "first" and "last".
+	void move(ShapeVertex * points, size_t index, const ci::Vec2f & position, size_t & first, size_t & last);
+
+private:
+
+	// Passes of ::build() over a slice of the field
+	void countSlice(const PointField & field, size_t begin, size_t end, uint32_t * histogram) const;
+	void fillSlice(const PointField & field, size_t begin, size_t end, uint32_t * cursor, ShapeVertex * sorted, ShapeVertex * copy) const;
+
+	// Returns the cell containing a position
+	int32_t getCell(const ci::Vec2f & position) const;
+
+	// Properties
+	ci::Rectf mBounds;
+	ci::Vec2f mCellSize;
+	std::vector<uint32_t> mCellStart;
+	int32_t mColumns;
+	int32_t mRows;
+
+};
+
 // GPU box mesh
 class ShapeApp : public ci::app::AppBasic 
 {
@@ -29,28 +132,55 @@ public:
 
 private:
 
-	// Shape types
+	// Shape types. "Mixed" gives every point a 
+	// random type, size, rotation, and color.
 	static const int32_t SHAPE_CIRCLE = 2;
+	static const int32_t SHAPE_MIXED = 3;
 	static const int32_t SHAPE_SQUARE = 1;
 	static const int32_t SHAPE_TRIANGLE = 0;
 
 	// Shape parameters
 	int32_t mShape;
+	int32_t mShapePrev;
 	int32_t mShapeCount;
 	int32_t mShapeCountPrev;
+	bool mSdf;
+	bool mSdfPrev;
 	float mSize;
 	bool mTransform;
 	bool mTransformPrev;
 
-	// Point list
+	// Point field
 	void initPoints();
-	std::vector<ci::Vec2f> mPoints;
+	PointField mPointField;
+	int32_t mSeed;
+	int32_t mSeedPrev;
+
+	// Spatial grid. We keep a copy of the sorted points
+	// so we can move them without reading back the buffer.
+	static const int32_t GRID_SIZE = 64;
+	void driftPoints();
+	bool mCull;
+	std::vector<GLsizei> mCullCounts;
+	std::vector<GLint> mCullFirsts;
+	int32_t mCulledCount;
+	int32_t mDriftCount;
+	PointGrid mPointGrid;
+	std::vector<ShapeVertex> mPoints;
+	int32_t mSubmittedCount;
+
+	// Point buffer
+	void drawPoints();
+	int32_t mPointCount;
+	ci::gl::Vbo mVbo;
+	int32_t mVboCapacity;
 
 	// Shader
 	void loadShader();
 	double mGlslVersion;
 	ci::gl::GlslProg mShader;
 	ci::gl::GlslProg mShaderPassThru;
+	ci::gl::GlslProg mShaderSdf;
 	ci::gl::GlslProg mShaderTransform;
 	
 	// Window
@@ -61,6 +191,10 @@ private:
 	bool mFullScreen;
 	bool mFullScreenPrev;
 
+	// Benchmark
+	static const int32_t BENCHMARK_FRAMES = 10;
+	void runBenchmark();
+
 	// Debug
 	ci::params::InterfaceGl mParams;
 	void screenShot();
@@ -73,6 +207,292 @@ using namespace ci;
 using namespace ci::app;
 using namespace std;
 
+// Constructor
+PointField::PointField()
+{
+	mBounds = Vec2f::one();
+	mMixed = false;
+	mSeed = 0;
+	mShape = 0;
+}
+
+// Fills the point buffer using every core
+void PointField::generate(ShapeVertex * points, size_t count) const
+{
+
+	// Small fields aren't worth the cost of starting threads
+	size_t threadCount = math<size_t>::max(thread::hardware_concurrency(), 1);
+	if (count < 65536 || threadCount == 1)
+	{
+		generateRange(points, 0, count);
+		return;
+	}
+
+	// Give each thread an equal slice of the buffer. The 
+	// calling thread takes the last slice.
+	size_t sliceSize = (count + threadCount - 1) / threadCount;
+	vector<shared_ptr<thread> > threads;
+	for (size_t begin = 0; begin + sliceSize < count; begin += sliceSize)
+		threads.push_back(shared_ptr<thread>(new thread(std::bind(& PointField::generateRange, this, points, begin, begin + sliceSize))));
+	generateRange(points, threads.size() * sliceSize, count);
+
+	// Wait for the other slices to finish
+	for (vector<shared_ptr<thread> >::iterator threadIt = threads.begin(); threadIt != threads.end(); ++threadIt)
+		(* threadIt)->join();
+
+}
+
+// Fills points in [begin, end)
+void PointField::generateRange(ShapeVertex * points, size_t begin, size_t end) const
+{
+	for (size_t i = begin; i < end; i++)
+		generatePoint(i, points[i]);
+}
+
+// Fills the point at "index"
+void PointField::generatePoint(size_t index, ShapeVertex & point) const
+{
+
+	// Two 64-bit random values per point. The first sets 
+	// the position. The second sets everything else.
+	uint64_t look = random(mSeed, (uint64_t)index * 2 + 1);
+	point.mPosition = getPosition(index);
+
+	// In mixed mode, every shape gets its own look. Otherwise, 
+	// we draw full size, white, unrotated shapes of one type.
+	if (mMixed)
+	{
+		point.mColor[0] = (uint8_t)look;
+		point.mColor[1] = (uint8_t)(look >> 8);
+		point.mColor[2] = (uint8_t)(look >> 16);
+		point.mColor[3] = 255;
+		point.mSize = (uint16_t)(16384 + ((uint32_t)(uint16_t)(look >> 24) * 49151 >> 16));
+		point.mRotation = (uint16_t)(look >> 40);
+		point.mShape = (uint8_t)(((uint32_t)(uint16_t)(look >> 48) * (uint32_t)mShape) >> 16);
+	}
+	else
+	{
+		point.mColor[0] = point.mColor[1] = point.mColor[2] = point.mColor[3] = 255;
+		point.mSize = 65535;
+		point.mRotation = 0;
+		point.mShape = (uint8_t)mShape;
+	}
+	point.mPadding[0] = point.mPadding[1] = point.mPadding[2] = 0;
+
+}
+
+// Returns the position of the point at "index", between 
+// -bounds and bounds
+Vec2f PointField::getPosition(size_t index) const
+{
+
+	// Scale for turning 24 random bits into a float in [0, 1)
+	static const float unit = 1.0f / 16777216.0f;
+
+	uint64_t position = random(mSeed, (uint64_t)index * 2);
+	return Vec2f(((float)(uint32_t)(position >> 40) * unit * 2.0f - 1.0f) * mBounds.x, 
+		((float)((uint32_t)(position >> 8) & 0xFFFFFF) * unit * 2.0f - 1.0f) * mBounds.y);
+
+}
+
+// Hashes the seed and counter into 64 random bits. This
+// is the SplitMix64 finalizer, which passes BigCrush.
+uint64_t PointField::random(uint32_t seed, uint64_t counter)
+{
+	uint64_t z = counter * 0x9E3779B97F4A7C15ULL + (uint64_t)seed * 0xD1B54A32D192ED03ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// Set area to fill
+void PointField::setBounds(const Vec2f & bounds)
+{
+	mBounds = bounds;
+}
+
+// Set random seed
+void PointField::setSeed(uint32_t seed)
+{
+	mSeed = seed;
+}
+
+// Set shape type
+void PointField::setShape(int32_t shape, bool mixed)
+{
+	mMixed = mixed;
+	mShape = shape;
+}
+
+// Constructor
+PointGrid::PointGrid()
+{
+	mBounds = Rectf(-1.0f, -1.0f, 1.0f, 1.0f);
+	mCellSize = Vec2f::one();
+	mColumns = 1;
+	mRows = 1;
+}
+
+// Generates points in cell order with a parallel counting 
+// sort. Each thread counts its slice's points per cell. A prefix 
+// sum over cells, then slices, gives each thread its own write
+// cursor in every cell. Then each thread generates its slice 
+// again, straight into place. Points in a cell stay in index 
+// order, so the result doesn't depend on the thread count.
+void PointGrid::build(const PointField & field, size_t count, const Rectf & bounds, int32_t columns, int32_t rows, ShapeVertex * sorted, ShapeVertex * copy)
+{
+
+	// Set grid dimensions
+	mBounds = bounds;
+	mColumns = math<int32_t>::max(columns, 1);
+	mRows = math<int32_t>::max(rows, 1);
+	mCellSize = Vec2f(mBounds.getWidth() / (float)mColumns, mBounds.getHeight() / (float)mRows);
+	int32_t cellCount = mColumns * mRows;
+	mCellStart.assign(cellCount + 1, 0);
+	if (count == 0)
+		return;
+
+	// Small fields aren't worth the cost of starting threads
+	size_t threadCount = math<size_t>::max(thread::hardware_concurrency(), 1);
+	if (count < 65536)
+		threadCount = 1;
+	size_t sliceSize = (count + threadCount - 1) / threadCount;
+	size_t sliceCount = (count + sliceSize - 1) / sliceSize;
+
+	// Count the points in each cell, one histogram per slice. 
+	// The calling thread takes the last slice.
+	vector<uint32_t> histograms(sliceCount * cellCount, 0);
+	vector<shared_ptr<thread> > threads;
+	for (size_t slice = 0; slice + 1 < sliceCount; slice++)
+		threads.push_back(shared_ptr<thread>(new thread(std::bind(& PointGrid::countSlice, this, std::cref(field), slice * sliceSize, (slice + 1) * sliceSize, & histograms[slice * cellCount]))));
+	countSlice(field, (sliceCount - 1) * sliceSize, count, & histograms[(sliceCount - 1) * cellCount]);
+	for (vector<shared_ptr<thread> >::iterator threadIt = threads.begin(); threadIt != threads.end(); ++threadIt)
+		(* threadIt)->join();
+	threads.clear();
+
+	// Turn counts into each cell's first index, and each 
+	// slice's first index within the cell
+	uint32_t start = 0;
+	for (int32_t cell = 0; cell < cellCount; cell++)
+	{
+		mCellStart[cell] = start;
+		for (size_t slice = 0; slice < sliceCount; slice++)
+		{
+			uint32_t & histogram = histograms[slice * cellCount + cell];
+			uint32_t points = histogram;
+			histogram = start;
+			start += points;
+		}
+	}
+	mCellStart[cellCount] = start;
+
+	// Generate each slice into place
+	for (size_t slice = 0; slice + 1 < sliceCount; slice++)
+		threads.push_back(shared_ptr<thread>(new thread(std::bind(& PointGrid::fillSlice, this, std::cref(field), slice * sliceSize, (slice + 1) * sliceSize, & histograms[slice * cellCount], sorted, copy))));
+	fillSlice(field, (sliceCount - 1) * sliceSize, count, & histograms[(sliceCount - 1) * cellCount], sorted, copy);
+	for (vector<shared_ptr<thread> >::iterator threadIt = threads.begin(); threadIt != threads.end(); ++threadIt)
+		(* threadIt)->join();
+
+}
+
+// Collects one draw range per row of visible cells
+void PointGrid::cull(const Rectf & rect, vector<GLint> & firsts, vector<GLsizei> & counts) const
+{
+
+	// Clear the output
+	firsts.clear();
+	counts.clear();
+	if (mCellStart.empty() || !rect.intersects(mBounds))
+		return;
+
+	// Find the cells the rectangle covers
+	int32_t column0 = math<int32_t>::clamp((int32_t)((rect.x1 - mBounds.x1) / mCellSize.x), 0, mColumns - 1);
+	int32_t column1 = math<int32_t>::clamp((int32_t)((rect.x2 - mBounds.x1) / mCellSize.x), 0, mColumns - 1);
+	int32_t row0 = math<int32_t>::clamp((int32_t)((rect.y1 - mBounds.y1) / mCellSize.y), 0, mRows - 1);
+	int32_t row1 = math<int32_t>::clamp((int32_t)((rect.y2 - mBounds.y1) / mCellSize.y), 0, mRows - 1);
+
+	// Cells in a row are contiguous, so each row is one range
+	for (int32_t row = row0; row <= row1; row++)
+	{
+		uint32_t first = mCellStart[row * mColumns + column0];
+		uint32_t last = mCellStart[row * mColumns + column1 + 1];
+		if (last > first)
+		{
+			firsts.push_back((GLint)first);
+			counts.push_back((GLsizei)(last - first));
+		}
+	}
+
+}
+
+// Counts the points in [begin, end) per cell. Only
+// positions are generated.
+void PointGrid::countSlice(const PointField & field, size_t begin, size_t end, uint32_t * histogram) const
+{
+	for (size_t i = begin; i < end; i++)
+		histogram[getCell(field.getPosition(i))]++;
+}
+
+// Generates the points in [begin, end) into their cells
+void PointGrid::fillSlice(const PointField & field, size_t begin, size_t end, uint32_t * cursor, ShapeVertex * sorted, ShapeVertex * copy) const
+{
+	ShapeVertex point;
+	for (size_t i = begin; i < end; i++)
+	{
+		field.generatePoint(i, point);
+		uint32_t index = cursor[getCell(point.mPosition)]++;
+		sorted[index] = point;
+		if (copy != 0)
+			copy[index] = point;
+	}
+}
+
+// Returns the cell index for a position
+int32_t PointGrid::getCell(const Vec2f & position) const
+{
+	int32_t column = math<int32_t>::clamp((int32_t)((position.x - mBounds.x1) / mCellSize.x), 0, mColumns - 1);
+	int32_t row = math<int32_t>::clamp((int32_t)((position.y - mBounds.y1) / mCellSize.y), 0, mRows - 1);
+	return row * mColumns + column;
+}
+
+// Moves a point, keeping the buffer sorted by cell
+void PointGrid::move(ShapeVertex * points, size_t index, const Vec2f & position, size_t & first, size_t & last)
+{
+
+	// Find the old and new cells
+	int32_t cellFrom = getCell(points[index].mPosition);
+	int32_t cellTo = getCell(position);
+	first = index;
+	last = index;
+
+	// Walk forward, swapping the point to the end of each cell
+	// and moving that cell's boundary back by one
+	while (cellFrom < cellTo)
+	{
+		size_t end = mCellStart[cellFrom + 1] - 1;
+		std::swap(points[index], points[end]);
+		mCellStart[cellFrom + 1]--;
+		index = end;
+		cellFrom++;
+	}
+
+	// Or walk backward, swapping to the start of each cell
+	while (cellFrom > cellTo)
+	{
+		size_t start = mCellStart[cellFrom];
+		std::swap(points[index], points[start]);
+		mCellStart[cellFrom]++;
+		index = start;
+		cellFrom--;
+	}
+
+	// Update position
+	points[index].mPosition = position;
+	first = math<size_t>::min(first, index);
+	last = math<size_t>::max(last, index);
+
+}
+
 // Renders the scene
 void ShapeApp::draw()
 {
@@ -85,15 +505,12 @@ void ShapeApp::draw()
 	// Bind and configure shader
 	mShader.bind();
 	mShader.uniform("aspect", getWindowAspectRatio());
-	mShader.uniform("shape", mShape);
+	mShader.uniform("pixel", 2.0f / (float)getWindowWidth());
 	mShader.uniform("size", mSize);
 	mShader.uniform("transform", mTransform);
 
 	// Draw points
-	glBegin(GL_POINTS);
-	for (vector<Vec2f>::const_iterator pointIt = mPoints.cbegin(); pointIt != mPoints.cend(); ++pointIt)
-		gl::vertex(* pointIt);
-	glEnd();
+	drawPoints();
 
 	// Unbind shader drawing
 	mShader.unbind();
@@ -103,19 +520,168 @@ void ShapeApp::draw()
 
 }
 
-// This fills a vector with random Vec2fs
+// Moves a handful of points each frame. This keeps the 
+// spatial grid sorted incrementally instead of rebuilding it.
+void ShapeApp::driftPoints()
+{
+
+	// Bail if there is nothing to move
+	if (mDriftCount <= 0 || mPoints.empty())
+		return;
+
+	// Move random points by up to eight pixels. Keep them 
+	// inside the area initPoints() fills.
+	Vec2f bounds((float)getWindowWidth(), (float)getWindowHeight());
+	size_t first = mPoints.size();
+	size_t last = 0;
+	for (int32_t i = 0; i < mDriftCount; i++)
+	{
+		uint64_t value = PointField::random((uint32_t)mSeed, ((uint64_t)getElapsedFrames() << 32) + (uint64_t)i);
+		size_t index = (size_t)((value & 0xFFFFFFFF) % mPoints.size());
+		Vec2f step((float)((int32_t)((value >> 32) & 0xFF) - 128) / 16.0f, (float)((int32_t)((value >> 40) & 0xFF) - 128) / 16.0f);
+		Vec2f position = mPoints[index].mPosition + step;
+		position.x = math<float>::clamp(position.x, -bounds.x, bounds.x);
+		position.y = math<float>::clamp(position.y, -bounds.y, bounds.y);
+
+		// Move the point and keep track of what changed
+		size_t moveFirst;
+		size_t moveLast;
+		mPointGrid.move(& mPoints[0], index, position, moveFirst, moveLast);
+		first = math<size_t>::min(first, moveFirst);
+		last = math<size_t>::max(last, moveLast);
+	}
+
+	// Upload the range that changed
+	mVbo.bind();
+	mVbo.bufferSubData(first * sizeof(ShapeVertex), (last - first + 1) * sizeof(ShapeVertex), & mPoints[first]);
+	mVbo.unbind();
+
+}
+
+// Draws the point buffer
+void ShapeApp::drawPoints()
+{
+
+	// Bail if there is nothing to draw
+	if (!mVbo || mPointCount <= 0)
+	{
+		mCulledCount = 0;
+		mSubmittedCount = 0;
+		return;
+	}
+
+	// Find the shape attributes in the current shader. These
+	// are -1 if the shader doesn't use them.
+	GLint colorLocation = mShader.getAttribLocation("shapeColor");
+	GLint paramsLocation = mShader.getAttribLocation("shapeParams");
+	GLint typeLocation = mShader.getAttribLocation("shapeType");
+
+	// Point the vertex arrays at the interleaved buffer
+	GLsizei stride = (GLsizei)sizeof(ShapeVertex);
+	mVbo.bind();
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_FLOAT, stride, (const GLvoid *)offsetof(ShapeVertex, mPosition));
+	if (colorLocation >= 0)
+	{
+		glEnableVertexAttribArray(colorLocation);
+		glVertexAttribPointer(colorLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (const GLvoid *)offsetof(ShapeVertex, mColor));
+	}
+	if (paramsLocation >= 0)
+	{
+		glEnableVertexAttribArray(paramsLocation);
+		glVertexAttribPointer(paramsLocation, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (const GLvoid *)offsetof(ShapeVertex, mSize));
+	}
+	if (typeLocation >= 0)
+	{
+		glEnableVertexAttribArray(typeLocation);
+		glVertexAttribPointer(typeLocation, 1, GL_UNSIGNED_BYTE, GL_FALSE, stride, (const GLvoid *)offsetof(ShapeVertex, mShape));
+	}
+
+	// Draw only the grid rows that overlap the window. We grow
+	// the window by the largest shape's radius so shapes on the
+	// edge aren't clipped. Otherwise, draw everything in one call.
+	if (mCull)
+	{
+		float margin = mSize * (float)getWindowWidth() * 0.5f + 2.0f;
+		mPointGrid.cull(Rectf(-margin, -margin, (float)getWindowWidth() + margin, (float)getWindowHeight() + margin), mCullFirsts, mCullCounts);
+		mSubmittedCount = 0;
+		for (vector<GLsizei>::const_iterator countIt = mCullCounts.cbegin(); countIt != mCullCounts.cend(); ++countIt)
+			mSubmittedCount += * countIt;
+		if (!mCullFirsts.empty())
+			glMultiDrawArrays(GL_POINTS, & mCullFirsts[0], & mCullCounts[0], (GLsizei)mCullFirsts.size());
+	}
+	else
+	{
+		mSubmittedCount = mPointCount;
+		glDrawArrays(GL_POINTS, 0, (GLsizei)mPointCount);
+	}
+	mCulledCount = mPointCount - mSubmittedCount;
+
+	// Restore state
+	if (colorLocation >= 0)
+		glDisableVertexAttribArray(colorLocation);
+	if (paramsLocation >= 0)
+		glDisableVertexAttribArray(paramsLocation);
+	if (typeLocation >= 0)
+		glDisableVertexAttribArray(typeLocation);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	mVbo.unbind();
+
+}
+
+// This fills the vertex buffer with shapes at random positions.
+// Points are generated in parallel, straight into the spatial 
+// grid's order in the mapped buffer. This runs when the window 
+// size, shape type, shape count, or seed changes.
 void ShapeApp::initPoints()
 {
 
-	// Clear current list
-	mPoints.clear();
+	// Configure the point field. Get window size as floats.
+	Vec2f bounds((float)getWindowWidth(), (float)getWindowHeight());
+	mPointField.setBounds(bounds);
+	mPointField.setSeed((uint32_t)mSeed);
+	mPointField.setShape(mShape, mShape == SHAPE_MIXED);
+	mPointCount = mShapeCount;
+
+	// The grid keeps a copy of the sorted points. The vector 
+	// keeps its capacity, so this only allocates when the 
+	// count grows.
+	mPoints.resize((size_t)mPointCount);
+	ShapeVertex * copy = mPoints.empty() ? 0 : & mPoints[0];
+
+	// Create the buffer the first time through
+	if (!mVbo)
+	{
+		mVbo = gl::Vbo(GL_ARRAY_BUFFER);
+		mVboCapacity = 0;
+	}
+
+	// Only grow the buffer's storage when the point count outgrows 
+	// it. Otherwise, we orphan the old storage so the driver 
+	// doesn't make us wait for the GPU to finish with it.
+	mVbo.bind();
+	mVboCapacity = math<int32_t>::max(mVboCapacity, mPointCount);
+	mVbo.bufferData((size_t)mVboCapacity * sizeof(ShapeVertex), 0, GL_STATIC_DRAW);
+
+	// Generate and sort the points in one pass, writing each 
+	// one to the buffer and to our copy
+	Rectf gridBounds(-bounds, bounds);
+	ShapeVertex * points = mPointCount > 0 ? (ShapeVertex *)mVbo.map(GL_WRITE_ONLY) : 0;
+	if (points != 0)
+	{
+		mPointGrid.build(mPointField, (size_t)mPointCount, gridBounds, GRID_SIZE, GRID_SIZE, points, copy);
+		mVbo.unmap();
+	}
+	else
+	{
 
-	// Get window size as floats
-	Vec2f windowSize((float)getWindowWidth(), (float)getWindowHeight());
+		// Fall back to filling the copy if we can't map the buffer
+		mPointGrid.build(mPointField, (size_t)mPointCount, gridBounds, GRID_SIZE, GRID_SIZE, copy, 0);
+		if (mPointCount > 0)
+			mVbo.bufferSubData(0, mPoints.size() * sizeof(ShapeVertex), copy);
 
-	// Add points at random spots on the screen
-	for (int32_t i = 0; i < mShapeCount; i++)
-		mPoints.push_back(Vec2f((Rand::randFloat() * 2.0f - 1.0f) * windowSize.x, (Rand::randFloat() * 2.0f - 1.0f) * windowSize.y));
+	}
+	mVbo.unbind();
 
 }
 
@@ -160,6 +726,16 @@ void ShapeApp::loadShader()
 				GL_POINTS, GL_TRIANGLE_STRIP, maxGeomOutputVertices
 				);
 
+			// The SDF shader draws every shape as a single quad
+			// and evaluates the shape's distance field per fragment,
+			// so it only needs four output vertices.
+			mShaderSdf = gl::GlslProg(
+				loadResource(RES_SHADER_VERT), 
+				loadResource(RES_SHADER_SDF_FRAG), 
+				loadResource(RES_SHADER_SDF_GEOM), 
+				GL_POINTS, GL_TRIANGLE_STRIP, 4
+				);
+
 		}
 		else
 		{
@@ -218,6 +794,94 @@ void ShapeApp::resize(ResizeEvent event)
 
 }
 
+// Draws the scene at increasing shape counts and writes the
+// throughput of the buffered and immediate mode paths to the console
+void ShapeApp::runBenchmark()
+{
+
+	// Time filling 10M points on the CPU. We reserve the
+	// buffer once up front.
+	{
+		vector<ShapeVertex> points(10000000);
+		glFinish();
+		Timer timer(true);
+		for (int32_t i = 0; i < BENCHMARK_FRAMES; i++)
+			mPointField.generate(& points[0], points.size());
+		double generate = timer.getSeconds() * 1000.0 / (double)BENCHMARK_FRAMES;
+		trace("Benchmark: generated " + toString(points.size()) + " points in " + toString(generate) + " ms (" + toString(thread::hardware_concurrency()) + " threads)");
+	}
+
+	// Remember the current shape count so we can restore it
+	int32_t shapeCount = mShapeCount;
+	trace("Benchmark: shapes, buffered ms, immediate ms, speed up");
+
+	// Sweep from 4K to 4M shapes
+	for (int32_t count = 4096; count <= 4194304; count *= 4)
+	{
+
+		// Build the point list
+		mShapeCount = count;
+		initPoints();
+
+		// Set up scene and shader exactly as draw() does
+		gl::setViewport(getWindowBounds());
+		gl::setMatricesWindow(getWindowSize());
+		mShader.bind();
+		mShader.uniform("aspect", getWindowAspectRatio());
+		mShader.uniform("pixel", 2.0f / (float)getWindowWidth());
+		mShader.uniform("size", mSize);
+		mShader.uniform("transform", mTransform);
+
+		// Time the buffered path. We call glFinish() so
+		// we measure the GPU's work, not just the submission.
+		glFinish();
+		Timer timer(true);
+		for (int32_t i = 0; i < BENCHMARK_FRAMES; i++)
+		{
+			gl::clear(mBackgroundColor, true);
+			drawPoints();
+			glFinish();
+		}
+		double buffered = timer.getSeconds() * 1000.0 / (double)BENCHMARK_FRAMES;
+
+		// Time the old immediate mode path for comparison
+		timer.start();
+		for (int32_t i = 0; i < BENCHMARK_FRAMES; i++)
+		{
+			gl::clear(mBackgroundColor, true);
+			GLint colorLocation = mShader.getAttribLocation("shapeColor");
+			GLint paramsLocation = mShader.getAttribLocation("shapeParams");
+			GLint typeLocation = mShader.getAttribLocation("shapeType");
+			glBegin(GL_POINTS);
+			for (vector<ShapeVertex>::const_iterator pointIt = mPoints.cbegin(); pointIt != mPoints.cend(); ++pointIt)
+			{
+				if (colorLocation >= 0)
+					glVertexAttrib4Nub(colorLocation, pointIt->mColor[0], pointIt->mColor[1], pointIt->mColor[2], pointIt->mColor[3]);
+				if (paramsLocation >= 0)
+					glVertexAttrib2f(paramsLocation, (float)pointIt->mSize / 65535.0f, (float)pointIt->mRotation / 65535.0f);
+				if (typeLocation >= 0)
+					glVertexAttrib1f(typeLocation, (float)pointIt->mShape);
+				gl::vertex(pointIt->mPosition);
+			}
+			glEnd();
+			glFinish();
+		}
+		double immediate = timer.getSeconds() * 1000.0 / (double)BENCHMARK_FRAMES;
+
+		// Stop drawing
+		mShader.unbind();
+
+		// Report
+		trace(toString(count) + ", " + toString(buffered) + ", " + toString(immediate) + ", " + toString(immediate / math<double>::max(buffered, 0.000001)) + "x");
+
+	}
+
+	// Restore the point list
+	mShapeCount = shapeCount;
+	initPoints();
+
+}
+
 // Take screen shot
 void ShapeApp::screenShot()
 {
@@ -236,24 +900,43 @@ void ShapeApp::setup()
 
 	// Set default parameters
 	mBackgroundColor = Colorf(0.415f, 0.434f, 0.508f);
+	mCull = true;
+	mCulledCount = 0;
+	mDriftCount = 0;
 	mFullScreen = isFullScreen();
 	mFullScreenPrev = mFullScreen;
 	mShape = 0;
+	mShapePrev = mShape;
 	mShapeCount = 512;
 	mShapeCountPrev = mShapeCount;
+	mPointCount = 0;
+	mSeed = 0;
+	mSeedPrev = mSeed;
+	mSdf = false;
+	mSdfPrev = mSdf;
 	mSize = 0.02f;
+	mSubmittedCount = 0;
+	mVboCapacity = 0;
 	mTransform = true;
 
 	// Create the parameters bar
-	mParams = params::InterfaceGl("Parameters", Vec2i(210, 200));
+	mParams = params::InterfaceGl("Parameters", Vec2i(210, 280));
 	mParams.addSeparator("");
-	mParams.addParam("Shape count", & mShapeCount, "min=0 max=4096 step=1 keyDecr=a keyIncr=A");
+	mParams.addParam("Shape count", & mShapeCount, "min=0 max=4194304 step=1 keyDecr=a keyIncr=A");
 	mParams.addParam("Shape size", & mSize, "min=0.0000 max=1.0000 step=0.0001 keyDecr=b keyIncr=B");
-	mParams.addParam("Shape type", & mShape, "min=0 max=2 step=1 keyDecr=c keyIncr=C");
+	mParams.addParam("Shape type", & mShape, "min=0 max=3 step=1 keyDecr=c keyIncr=C");
 	mParams.addParam("Shape transform", & mTransform, "key=d");
+	mParams.addParam("Shape SDF", & mSdf, "key=h");
+	mParams.addParam("Seed", & mSeed, "min=0 step=1 keyDecr=g keyIncr=G");
+	mParams.addSeparator("");
+	mParams.addParam("Cull to window", & mCull, "key=i");
+	mParams.addParam("Drift count", & mDriftCount, "min=0 max=65536 step=64 keyDecr=j keyIncr=J");
+	mParams.addParam("Points submitted", & mSubmittedCount, "", true);
+	mParams.addParam("Points culled", & mCulledCount, "", true);
 	mParams.addSeparator("");
 	mParams.addParam("Frame rate", & mFrameRate, "", true);
 	mParams.addParam("Full screen", & mFullScreen, "key=e");
+	mParams.addButton("Run benchmark", std::bind(& ShapeApp::runBenchmark, this), "key=f");
 	mParams.addButton("Save screen shot", std::bind(& ShapeApp::screenShot, this), "key=space");
 	mParams.addButton("Quit", std::bind(& ShapeApp::quit, this), "key=esc");
 
@@ -268,10 +951,14 @@ void ShapeApp::shutdown()
 
 	// Clean up
 	mPoints.clear();
+	if (mVbo)
+		mVbo.reset();
 	if (mShader)
 		mShader.reset();
 	if (mShaderPassThru)
 		mShaderPassThru.reset();
+	if (mShaderSdf)
+		mShaderSdf.reset();
 	if (mShaderTransform)
 		mShaderTransform.reset();
 	
@@ -308,17 +995,26 @@ void ShapeApp::update()
 		mFullScreenPrev = mFullScreen;
 	}
 
-	// Update point list when shape count changes
-	if (mShapeCount != mShapeCountPrev)
+	// Update point list when shape count, type, or seed changes
+	if (mShapeCount != mShapeCountPrev || 
+		mShape != mShapePrev || 
+		mSeed != mSeedPrev)
 	{
 		initPoints();
+		mSeedPrev = mSeed;
 		mShapeCountPrev = mShapeCount;
+		mShapePrev = mShape;
 	}
 
-	// Toggle between transform and pass-thru shader
-	if (mTransform != mTransformPrev)
+	// Move points around the grid
+	driftPoints();
+
+	// Toggle between transform, SDF, and pass-thru shaders
+	if (mTransform != mTransformPrev || 
+		mSdf != mSdfPrev)
 	{
-		mShader = mTransform ? mShaderTransform : mShaderPassThru;
+		mShader = mTransform ? (mSdf ? mShaderSdf : mShaderTransform) : mShaderPassThru;
+		mSdfPrev = mSdf;
 		mTransformPrev = mTransform;
 	}
 
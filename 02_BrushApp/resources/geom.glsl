@@ -4,9 +4,11 @@
 
 // Uniforms
 uniform float aspect;
-uniform float size;
 uniform bool transform;
 
+// Input attributes
+varying in float sizeIn[];
+
 // Output attributes
 varying vec2 uv;
 
@@ -18,6 +20,9 @@ void main(void)
 	if (transform)
 	{
 
+		// Each dab carries its own size
+		float size = sizeIn[0];
+
 		// To draw a square, we will draw two triangles, just like 
 		// above. The two triangles will share vertices, so we'll define
 		// the vertices in advance.
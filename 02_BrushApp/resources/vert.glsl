@@ -1,5 +1,11 @@
 #version 120
 
+// Input attributes
+attribute float dabSize;
+
+// Output attributes
+varying float sizeIn;
+
 // Kernel
 void main(void)
 {
@@ -7,4 +13,7 @@ void main(void)
 	// Transform position
 	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
 
+	// Pass the dab's size to the geometry shader
+	sizeIn = dabSize;
+
 }
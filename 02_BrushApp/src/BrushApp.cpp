@@ -1,96 +1,1792 @@
 // Includes
 #include <cinder/app/AppBasic.h>
+#include <cinder/gl/Fbo.h>
 #include <cinder/gl/GlslProg.h>
 #include <cinder/gl/Texture.h>
+#include <cinder/gl/Vbo.h>
 #include <cinder/ImageIo.h>
 #include <cinder/params/Params.h>
 #include <cinder/Rand.h>
+#include <cinder/Thread.h>
+#include <cinder/Timer.h>
 #include <cinder/Utilities.h>
+#include <ctime>
+#include <deque>
+#include <emmintrin.h>
+#include <map>
 #include <Resources.h>
+#include <xmmintrin.h>
+#ifndef CINDER_MSW
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * This application demonstrates the basics of how
+ * to load and configure a geometry shader. It converts 
+ * points to shapes generated in GLSL.
+ */
+
+// A single brush dab in the stroke log. Positions are in
+// window pixels and size is normalized, so a dab is 6 bytes.
+struct BrushDab
+{
+	int16_t mX;
+	int16_t mY;
+	uint16_t mSize;
+};
+
+// Stroke recordings are a 16 byte header followed by 12 byte
+// records, written in order as the session runs. Records are 
+// fixed size, so a recording can be memory mapped and read in
+// place, and a file cut short by a crash loses at most the 
+// last partial record.
+struct StrokeHeader
+{
+	char mMagic[4];			// "BRSH"
+	uint32_t mVersion;
+	int32_t mWidth;			// Canvas size when recorded
+	int32_t mHeight;
+};
+
+struct StrokeRecord
+{
+	static const uint16_t TYPE_DAB = 0;
+	static const uint16_t TYPE_CLEAR = 1;
+	static const uint16_t TYPE_END = 2;			// End of stroke
+	static const uint16_t TYPE_REDO = 3;
+	static const uint16_t TYPE_UNDO = 4;
+
+	uint32_t mTime;			// Milliseconds since the session started
+	uint16_t mType;
+	int16_t mX;				// Dab position and size, as in BrushDab
+	int16_t mY;
+	uint16_t mSize;
+};
+
+// Renders the stroke log on the CPU at any resolution. Each dab
+// is a copy of the brush image, resampled once per dab size into
+// a premultiplied stamp, then added to the target with saturating
+// SSE2 adds. This is the same math as the GPU's additive blend, 
+// so the result matches the canvas. Pass-thru dabs are drawn as
+// the smoothed, 3 pixel white points the GPU draws without the
+// geometry shader. The target is split into bands of rows, 
+// shared across every core. No GL context is needed, so this 
+// can run headless.
+class BrushCompositor
+{
+
+public:
+
+	BrushCompositor();
+
+	// Draws "count" dabs into "surface", scaling the canvas to 
+	// the surface's width. Set "transform" to false to draw 
+	// dabs as points, like the pass-thru shader.
+	void render(const BrushDab * dabs, size_t count, const ci::Vec2i & canvasSize, bool transform, ci::Surface8u & surface) const;
+
+	// Sets the image used as the dab stamp
+	void setBrush(const ci::Surface8u & brush);
+
+private:
+
+	// Rows in each band
+	static const int32_t BAND_HEIGHT = 64;
+
+	// A brush image resampled to one dab size. Pixels 
+	// are premultiplied, in the target's channel order.
+	struct Stamp
+	{
+		int32_t mOffset;
+		std::vector<uint8_t> mPixels;
+		int32_t mSize;
+	};
+
+	// Adds a row of pixels, saturating at 255
+	static void addRow(uint8_t * destination, const uint8_t * source, size_t byteCount);
+
+	// Resamples the brush for a dab with a half width of 
+	// "extent", or draws a point if "transform" is false
+	void buildStamp(float extent, bool transform, const int32_t offsets[4], Stamp & stamp) const;
+
+	// Draws the dabs in bands "band", "band" + "step", and so on
+	void renderBands(const std::vector<std::vector<uint32_t> > & bands, int32_t band, int32_t step, const std::vector<ci::Vec2i> & centers, const std::vector<uint32_t> & stamps, const std::vector<Stamp> & stampList, ci::Surface8u & surface) const;
+
+	// Brush image as RGBA floats
+	std::vector<float> mBrush;
+	int32_t mBrushHeight;
+	int32_t mBrushWidth;
+
+};
+
+// Turns raw mouse samples into evenly spaced dabs. Samples are
+// joined with Catmull-Rom splines, and each segment is measured
+// by arc length so dabs land a fixed distance apart no matter
+// how fast the mouse moves. Segment points and lengths are 
+// evaluated four at a time with SSE.
+class BrushStroke
+{
+
+public:
+
+	BrushStroke();
+
+	// Starts a stroke, writing a dab at the first point
+	void begin(const ci::Vec2f & point, std::vector<ci::Vec2f> & dabs);
+
+	// Finishes the stroke, writing dabs for the last segment
+	void end(std::vector<ci::Vec2f> & dabs);
+
+	// Returns true between begin() and end()
+	bool isActive() const;
+
+	// Distance between dabs, in pixels
+	void setSpacing(float spacing);
+
+	// Adds a batch of samples, writing dabs for every
+	// segment they complete
+	void update(const std::vector<ci::Vec2f> & points, std::vector<ci::Vec2f> & dabs);
+
+private:
+
+	// Each segment is measured as this many straight steps
+	static const int32_t SEGMENT_STEPS = 16;
+
+	// Adds a control point, drawing the segment it completes
+	void addPoint(const ci::Vec2f & point, std::vector<ci::Vec2f> & dabs);
+
+	// Writes dabs along the spline from p1 to p2
+	void drawSegment(const ci::Vec2f & p0, const ci::Vec2f & p1, const ci::Vec2f & p2, const ci::Vec2f & p3, std::vector<ci::Vec2f> & dabs);
+
+	// Properties
+	bool mActive;
+	ci::Vec2f mControl[4];
+	int32_t mControlCount;
+	float mRemaining;
+	float mSpacing;
+
+};
+
+// Opens a stroke recording by mapping it into memory. Records
+// are read straight from the mapping, so opening is instant no 
+// matter how long the recording is.
+class StrokeReader
+{
+
+public:
+
+	StrokeReader();
+	~StrokeReader();
+
+	// Unmaps the file
+	void close();
+
+	// Canvas size when the recording was made
+	const ci::Vec2i & getCanvasSize() const;
+
+	// Records in the file. Any partial record 
+	// at the end is ignored.
+	size_t getCount() const;
+	const StrokeRecord * getRecords() const;
+
+	// Plays every record into "log", applying clears, 
+	// undos, and redos, to get the final stroke log
+	void getDabs(std::vector<BrushDab> & log) const;
+
+	// Maps a file. Returns false if it isn't a recording.
+	bool open(const ci::fs::path & path);
+
+private:
+
+	// Properties
+	ci::Vec2i mCanvasSize;
+	size_t mCount;
+	const uint8_t * mData;
+	size_t mSize;
+
+	// File handles
+#ifdef CINDER_MSW
+	HANDLE mFile;
+	HANDLE mMapping;
+#else
+	int mFile;
+#endif
+
+};
+
+// Appends records to a stroke recording. Records are queued in 
+// memory and written by a background thread, so recording never
+// waits on the disk.
+class StrokeRecorder
+{
+
+public:
+
+	StrokeRecorder();
+	~StrokeRecorder();
+
+	// Writes any queued records and closes the file
+	void close();
+
+	// Wakes the writer thread to write queued records
+	void flush();
+	bool isOpen() const;
+
+	// Creates a recording and starts the writer thread
+	bool open(const ci::fs::path & path, const ci::Vec2i & canvasSize);
+
+	// Queues a record
+	void write(const StrokeRecord & record);
+
+private:
+
+	// Writer thread loop
+	void run();
+
+	// Properties
+	std::condition_variable mCondition;
+	FILE * mFile;
+	std::mutex mMutex;
+	std::vector<StrokeRecord> mQueue;
+	bool mRunning;
+	std::shared_ptr<std::thread> mThread;
+
+};
+
+// Undo history for the canvas. The canvas is split into tiles,
+// and each stroke saves only the tiles it touched, before and
+// after it was painted. Undo and redo copy those tiles back into
+// the canvas, so their cost depends on the size of one stroke,
+// not on the length of the history. Tiles are read back through
+// a ring of pixel buffers, so saving one doesn't wait on the GPU.
+// Older strokes are run-length encoded, then dropped, to keep 
+// the history under a budget.
+class TileHistory
+{
+
+public:
+
+	TileHistory();
+
+	// Starts recording a stroke. Dabs from "firstDab" 
+	// on in the stroke log belong to it.
+	void begin(size_t firstDab);
+
+	// Clears the history
+	void clear();
+
+	// Finishes the stroke, saving the tiles it changed. 
+	// Dabs up to "lastDab" belong to the stroke.
+	void end(ci::gl::Fbo & canvas, size_t lastDab);
+
+	// Returns memory used by the history, in bytes
+	size_t getByteCount() const;
+
+	// Returns the range of dabs in the log that belong
+	// to stroke "index", counting from the oldest
+	void getDabRange(size_t index, size_t & firstDab, size_t & lastDab) const;
+
+	// Number of strokes in the log, which can be undone
+	size_t getStrokeCount() const;
+
+	// Saved tiles no longer match a canvas that has been
+	// resized or repainted. Strokes keep their dabs, and 
+	// their tiles are saved again with resume().
+	void invalidate(const ci::Vec2i & size);
+	bool isRecording() const;
+
+	// Moves the next stroke's dabs back into the log and 
+	// restores its tiles. If its tiles are no longer valid,
+	// "repaint" is set and the caller must paint the dabs,
+	// saving its tiles again with resume().
+	bool redo(ci::gl::Fbo & canvas, std::vector<BrushDab> & log, bool & repaint);
+
+	// Sets the memory budget, in bytes
+	void setBudget(size_t bytes);
+
+	// Saves the tiles under "area" that this stroke 
+	// hasn't touched yet. Call this before painting.
+	void touch(ci::gl::Fbo & canvas, const ci::Area & area);
+
+	// Starts saving the tiles of stroke "index" again, after 
+	// invalidate() or a redo that repainted it. Touch and 
+	// paint its dabs, then call end().
+	void resume(size_t index);
+
+	// Restores the tiles under the last stroke and moves 
+	// its dabs out of the log. If its tiles are no longer 
+	// valid, "replay" is set and the caller must repaint 
+	// the canvas from the log.
+	bool undo(ci::gl::Fbo & canvas, std::vector<BrushDab> & log, bool & replay);
+
+private:
+
+	// Tiles are square
+	static const int32_t TILE_SIZE = 64;
+
+	// Pixel buffers in the readback ring
+	static const int32_t READBACK_COUNT = 32;
+
+	// A saved tile. Pixels are either raw or run-length
+	// encoded as (count, color) pairs.
+	struct Tile
+	{
+		bool mCompressed;
+		int32_t mIndex;
+		std::vector<uint32_t> mPixels;
+	};
+
+	// A recorded stroke
+	struct Stroke
+	{
+		std::vector<Tile> mAfter;
+		std::vector<Tile> mBefore;
+		bool mCompressed;
+		std::vector<BrushDab> mDabs;
+		size_t mFirstDab;
+		size_t mLastDab;
+		bool mValid;
+	};
+
+	// A tile being read back into the recording stroke
+	struct Readback
+	{
+		bool mAfter;
+		ci::gl::Vbo mPbo;
+		bool mPending;
+		size_t mTile;
+	};
+
+	// Tile storage
+	void compress(Tile & tile);
+	ci::Area getTileArea(int32_t index) const;
+	static size_t getByteCount(const Stroke & stroke);
+	void writeTile(ci::gl::Fbo & canvas, const Tile & tile);
+
+	// Tile readback. A tile is copied out of its buffer when 
+	// the ring comes back around to it, or when the stroke ends.
+	void finishReadback(Readback & readback);
+	void readTile(ci::gl::Fbo & canvas, int32_t index, bool after, size_t tile);
+	Readback mReadbacks[READBACK_COUNT];
+	int32_t mReadbackIndex;
+
+	// Compresses, then drops, strokes until the
+	// history fits in its budget
+	void trim();
+
+	// Properties
+	size_t mBudget;
+	size_t mByteCount;
+	int32_t mColumns;
+	size_t mPosition;
+	bool mRecording;
+	size_t mRecordIndex;
+	bool mResumed;
+	int32_t mRows;
+	std::vector<uint32_t> mScratch;
+	ci::Vec2i mSize;
+	std::deque<Stroke> mStrokes;
+	std::vector<uint8_t> mTileSaved;
+
+};
+
+// GPU box mesh
+class BrushApp : public ci::app::AppBasic 
+{
+
+public:
+
+	// Cinder callbacks
+	void draw();
+	void mouseDown(ci::app::MouseEvent event);
+	void mouseDrag(ci::app::MouseEvent event);
+	void mouseUp(ci::app::MouseEvent event);
+	void prepareSettings(ci::app::AppBasic::Settings * settings);
+	void resize(ci::app::ResizeEvent event);
+	void setup();
+	void shutdown();
+	void update();
+
+private:
+
+	// Brush
+	ci::Surface8u mBrush;
+	float mSize;
+	float mSpacing;
+	ci::gl::Texture mTexture;
+
+	// Print export. The stroke log is rendered on the CPU
+	// at any width, independent of the window. Recordings
+	// can also be printed without a window by running 
+	// "BrushApp --print <file> [width] [--pass-thru]".
+	void comparePrint(const ci::Surface8u & window);
+	void exportPrint();
+	bool printRecording(const ci::fs::path & path, int32_t width, bool transform);
+	void verifyPrint();
+	BrushCompositor mCompositor;
+	int32_t mExportWidth;
+	bool mTransform;
+	bool mTransformPrev;
+	bool mVerifyPrint;
+
+	// Stroke. Mouse samples are collected as they arrive 
+	// and interpolated into dabs once per frame.
+	void addDabs();
+	int32_t mDabCount;
+	BrushStroke mStroke;
+	std::vector<ci::Vec2f> mStrokeDabs;
+	std::vector<ci::Vec2f> mStrokeSamples;
+
+	// Canvas. Dabs are painted into the canvas once, as they are
+	// added. The stroke log keeps the full history so the canvas 
+	// can be repainted when the window size or shader changes.
+	void clearCanvas();
+	void drawDabs(size_t first, size_t last);
+	void initCanvas();
+	ci::gl::Fbo mCanvas;
+	size_t mCanvasDabCount;
+	std::vector<BrushDab> mStrokeLog;
+
+	// Recording. Every session that paints is recorded to 
+	// disk, and recordings can be replayed faster than real 
+	// time. The file is created with the first dab.
+	void record(uint16_t type, int16_t x = 0, int16_t y = 0, uint16_t size = 0);
+	void replay();
+	void startReplay();
+	StrokeReader mReader;
+	bool mRecordSession;
+	StrokeRecorder mRecorder;
+	size_t mReplayIndex;
+	bool mReplaying;
+	float mReplaySpeed;
+	double mReplayStart;
+	bool mReplayStroke;
+
+	// Undo history
+	void redo();
+	void touchDabs(size_t first, size_t last);
+	void undo();
+	TileHistory mHistory;
+	int32_t mHistoryBudget;
+	int32_t mHistoryBudgetPrev;
+	int32_t mHistoryKilobytes;
+
+	// Shader
+	void loadShader();
+	double mGlslVersion;
+	ci::gl::GlslProg mShader;
+	ci::gl::GlslProg mShaderPassThru;
+	ci::gl::GlslProg mShaderTransform;
+	
+	// Window
+	float mElapsedFrames;
+	float mElapsedSeconds;
+	float mFrameRate;
+	bool mFullScreen;
+	bool mFullScreenPrev;
+
+	// Debug
+	ci::params::InterfaceGl mParams;
+	void screenShot();
+	void trace(const std::string & message);
+
+};
+
+// Import namespaces
+using namespace ci;
+using namespace ci::app;
+using namespace std;
+
+// Constructor
+BrushCompositor::BrushCompositor()
+{
+	mBrushHeight = 0;
+	mBrushWidth = 0;
+}
+
+// Saturating add, 16 bytes at a time
+void BrushCompositor::addRow(uint8_t * destination, const uint8_t * source, size_t byteCount)
+{
+
+	// Vector part
+	size_t i = 0;
+	for (; i + 16 <= byteCount; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(destination + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(source + i));
+		_mm_storeu_si128((__m128i *)(destination + i), _mm_adds_epu8(a, b));
+	}
+
+	// Remainder
+	for (; i < byteCount; i++)
+		destination[i] = (uint8_t)math<int32_t>::min((int32_t)destination[i] + (int32_t)source[i], 255);
+
+}
+
+// Resamples the brush into a stamp. The dab's center sits on
+// a pixel corner, and each stamp pixel is sampled at its center 
+// with the same UV layout as the geometry shader.
+void BrushCompositor::buildStamp(float extent, bool transform, const int32_t offsets[4], Stamp & stamp) const
+{
+
+	// Find the pixels whose centers fall inside the quad
+	int32_t first = (int32_t)math<float>::ceil(-extent - 0.5f);
+	int32_t last = (int32_t)math<float>::floor(extent - 0.5f);
+	stamp.mOffset = first;
+	stamp.mSize = math<int32_t>::max(last - first + 1, 0);
+	stamp.mPixels.assign(stamp.mSize * stamp.mSize * 4, 0);
+	if (stamp.mSize == 0)
+		return;
+
+	// Smoothed points are round and opaque white, 
+	// so every channel is full inside the circle
+	if (!transform)
+	{
+		for (int32_t y = 0; y < stamp.mSize; y++)
+			for (int32_t x = 0; x < stamp.mSize; x++)
+			{
+				float dx = (float)(first + x) + 0.5f;
+				float dy = (float)(first + y) + 0.5f;
+				if (dx * dx + dy * dy <= extent * extent)
+					memset(& stamp.mPixels[(y * stamp.mSize + x) * 4], 255, 4);
+			}
+		return;
+	}
+	if (mBrush.empty())
+		return;
+
+	// Sample the brush
+	float scale = 0.5f / extent;
+	for (int32_t y = 0; y < stamp.mSize; y++)
+		for (int32_t x = 0; x < stamp.mSize; x++)
+		{
+
+			// The shader maps window Y to U, and
+			// window X to V, flipped
+			float u = ((float)(first + y) + 0.5f + extent) * scale;
+			float v = (extent - (float)(first + x) - 0.5f) * scale;
+
+			// Bilinear sample, clamped to the edge
+			float fx = math<float>::clamp(u * (float)mBrushWidth - 0.5f, 0.0f, (float)(mBrushWidth - 1));
+			float fy = math<float>::clamp(v * (float)mBrushHeight - 0.5f, 0.0f, (float)(mBrushHeight - 1));
+			int32_t x0 = (int32_t)fx;
+			int32_t y0 = (int32_t)fy;
+			int32_t x1 = math<int32_t>::min(x0 + 1, mBrushWidth - 1);
+			int32_t y1 = math<int32_t>::min(y0 + 1, mBrushHeight - 1);
+			float tx = fx - (float)x0;
+			float ty = fy - (float)y0;
+			float color[4];
+			for (int32_t c = 0; c < 4; c++)
+			{
+				float top = mBrush[(y0 * mBrushWidth + x0) * 4 + c] * (1.0f - tx) + mBrush[(y0 * mBrushWidth + x1) * 4 + c] * tx;
+				float bottom = mBrush[(y1 * mBrushWidth + x0) * 4 + c] * (1.0f - tx) + mBrush[(y1 * mBrushWidth + x1) * 4 + c] * tx;
+				color[c] = top * (1.0f - ty) + bottom * ty;
+			}
+
+			// Additive blending scales everything by source
+			// alpha, including alpha itself
+			uint8_t * pixel = & stamp.mPixels[(y * stamp.mSize + x) * 4];
+			for (int32_t c = 0; c < 4; c++)
+				pixel[offsets[c]] = (uint8_t)(color[c] * color[3] * 255.0f + 0.5f);
+
+		}
+
+}
+
+// Draws the stroke log into a surface
+void BrushCompositor::render(const BrushDab * dabs, size_t count, const Vec2i & canvasSize, bool transform, Surface8u & surface) const
+{
+
+	// Clear the target. Prints can pass 2GB, so
+	// the byte count is computed in size_t.
+	int32_t width = surface.getWidth();
+	int32_t height = surface.getHeight();
+	size_t rowBytes = (size_t)surface.getRowBytes();
+	memset(surface.getData(), 0, rowBytes * (size_t)height);
+	if (canvasSize.x <= 0 || width <= 0 || height <= 0)
+		return;
+
+	// Stamps are written in the target's channel order
+	int32_t offsets[4] = { surface.getRedOffset(), surface.getGreenOffset(), surface.getBlueOffset(), surface.getAlphaOffset() };
+
+	// Build one stamp per dab size, and put each dab in every
+	// band its stamp overlaps. Points are 3 window pixels wide
+	// whatever the dab's size, so they all share one stamp.
+	float scale = (float)width / (float)canvasSize.x;
+	float extentScale = (float)width * 0.5f * 0.7071f / 65535.0f;
+	float pointExtent = 1.5f * scale;
+	int32_t bandCount = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+	vector<vector<uint32_t> > bands(bandCount);
+	vector<Vec2i> centers(count);
+	map<uint16_t, uint32_t> stampIndex;
+	vector<uint32_t> stamps(count);
+	vector<Stamp> stampList;
+	for (size_t i = 0; i < count; i++)
+	{
+
+		// Look up the stamp, building it if it's new
+		uint16_t key = transform ? dabs[i].mSize : 0;
+		map<uint16_t, uint32_t>::const_iterator stampIt = stampIndex.find(key);
+		if (stampIt == stampIndex.end())
+		{
+			stampList.push_back(Stamp());
+			buildStamp(transform ? (float)dabs[i].mSize * extentScale : pointExtent, transform, offsets, stampList.back());
+			stampIt = stampIndex.insert(make_pair(key, (uint32_t)(stampList.size() - 1))).first;
+		}
+		stamps[i] = stampIt->second;
+
+		// Dab centers are rounded to the nearest pixel corner
+		const Stamp & stamp = stampList[stamps[i]];
+		centers[i] = Vec2i((int32_t)math<float>::floor((float)dabs[i].mX * scale + 0.5f), (int32_t)math<float>::floor((float)dabs[i].mY * scale + 0.5f));
+		int32_t top = math<int32_t>::max(centers[i].y + stamp.mOffset, 0);
+		int32_t bottom = math<int32_t>::min(centers[i].y + stamp.mOffset + stamp.mSize, height);
+		if (top < bottom)
+			for (int32_t band = top / BAND_HEIGHT; band * BAND_HEIGHT < bottom; band++)
+				bands[band].push_back((uint32_t)i);
+
+	}
+
+	// Small targets aren't worth the threads
+	int32_t threadCount = math<int32_t>::clamp((int32_t)thread::hardware_concurrency(), 1, bandCount);
+	if (threadCount == 1)
+	{
+		renderBands(bands, 0, 1, centers, stamps, stampList, surface);
+		return;
+	}
+
+	// Interleave bands across threads, so dense areas are 
+	// shared evenly. The calling thread takes the first set.
+	vector<shared_ptr<thread> > threads;
+	for (int32_t i = 1; i < threadCount; i++)
+		threads.push_back(shared_ptr<thread>(new thread(std::bind(& BrushCompositor::renderBands, this, std::cref(bands), i, threadCount, std::cref(centers), std::cref(stamps), std::cref(stampList), std::ref(surface)))));
+	renderBands(bands, 0, threadCount, centers, stamps, stampList, surface);
+
+	// Wait for the other bands to finish
+	for (vector<shared_ptr<thread> >::iterator threadIt = threads.begin(); threadIt != threads.end(); ++threadIt)
+		(* threadIt)->join();
+
+}
+
+// Draws a set of bands. Bands don't overlap, so 
+// threads never write to the same row.
+void BrushCompositor::renderBands(const vector<vector<uint32_t> > & bands, int32_t band, int32_t step, const vector<Vec2i> & centers, const vector<uint32_t> & stamps, const vector<Stamp> & stampList, Surface8u & surface) const
+{
+
+	// Iterate through bands
+	int32_t width = surface.getWidth();
+	int32_t height = surface.getHeight();
+	size_t rowBytes = (size_t)surface.getRowBytes();
+	int32_t alphaOffset = surface.getAlphaOffset();
+	for (int32_t b = band; b < (int32_t)bands.size(); b += step)
+	{
+
+		// Add each dab's rows that fall in this band
+		int32_t bandTop = b * BAND_HEIGHT;
+		int32_t bandBottom = math<int32_t>::min(bandTop + BAND_HEIGHT, height);
+		for (vector<uint32_t>::const_iterator dabIt = bands[b].begin(); dabIt != bands[b].end(); ++dabIt)
+		{
+			const Stamp & stamp = stampList[stamps[* dabIt]];
+			const Vec2i & center = centers[* dabIt];
+			int32_t left = center.x + stamp.mOffset;
+			int32_t x0 = math<int32_t>::max(left, 0);
+			int32_t x1 = math<int32_t>::min(left + stamp.mSize, width);
+			if (x0 >= x1)
+				continue;
+			int32_t top = center.y + stamp.mOffset;
+			int32_t y0 = math<int32_t>::max(top, bandTop);
+			int32_t y1 = math<int32_t>::min(top + stamp.mSize, bandBottom);
+			for (int32_t y = y0; y < y1; y++)
+				addRow(surface.getData() + (size_t)y * rowBytes + x0 * 4, & stamp.mPixels[((y - top) * stamp.mSize + x0 - left) * 4], (x1 - x0) * 4);
+		}
+
+		// The canvas is drawn to the screen without blending, 
+		// so the print is opaque
+		for (int32_t y = bandTop; y < bandBottom; y++)
+		{
+			uint8_t * row = surface.getData() + (size_t)y * rowBytes;
+			for (int32_t x = 0; x < width; x++)
+				row[x * 4 + alphaOffset] = 255;
+		}
+
+	}
+
+}
+
+// Set brush image
+void BrushCompositor::setBrush(const Surface8u & brush)
+{
+
+	// Convert the brush to RGBA floats
+	mBrushWidth = brush.getWidth();
+	mBrushHeight = brush.getHeight();
+	mBrush.resize(mBrushWidth * mBrushHeight * 4);
+	int32_t increment = brush.getPixelInc();
+	int32_t offsets[4] = { brush.getRedOffset(), brush.getGreenOffset(), brush.getBlueOffset(), brush.getAlphaOffset() };
+	for (int32_t y = 0; y < mBrushHeight; y++)
+	{
+		const uint8_t * row = brush.getData() + y * brush.getRowBytes();
+		for (int32_t x = 0; x < mBrushWidth; x++)
+			for (int32_t c = 0; c < 4; c++)
+				mBrush[(y * mBrushWidth + x) * 4 + c] = offsets[c] < 0 ? 1.0f : (float)row[x * increment + offsets[c]] / 255.0f;
+	}
+
+}
+
+// Constructor
+BrushStroke::BrushStroke()
+{
+	mActive = false;
+	mControlCount = 0;
+	mRemaining = 0.0f;
+	mSpacing = 1.0f;
+}
+
+// Shifts a point into the control window
+void BrushStroke::addPoint(const Vec2f & point, vector<Vec2f> & dabs)
+{
+
+	// Fill the window, then slide it
+	if (mControlCount < 4)
+	{
+		mControl[mControlCount++] = point;
+	}
+	else
+	{
+		mControl[0] = mControl[1];
+		mControl[1] = mControl[2];
+		mControl[2] = mControl[3];
+		mControl[3] = point;
+	}
+
+	// With four points, the middle segment is known
+	if (mControlCount == 4)
+		drawSegment(mControl[0], mControl[1], mControl[2], mControl[3], dabs);
+
+}
+
+// Starts a stroke
+void BrushStroke::begin(const Vec2f & point, vector<Vec2f> & dabs)
+{
+
+	// The first point is doubled so the first
+	// segment has a control point behind it
+	mActive = true;
+	mControl[0] = point;
+	mControl[1] = point;
+	mControlCount = 2;
+
+	// Always mark the start of a stroke
+	dabs.push_back(point);
+	mRemaining = mSpacing;
+
+}
+
+// Evaluates a Catmull-Rom segment at evenly spaced
+// steps, then walks it by arc length
+void BrushStroke::drawSegment(const Vec2f & p0, const Vec2f & p1, const Vec2f & p2, const Vec2f & p3, vector<Vec2f> & dabs)
+{
+
+	// Polynomial coefficients, so P(t) = a + bt + ct^2 + dt^3
+	Vec2f a = p1;
+	Vec2f b = (p2 - p0) * 0.5f;
+	Vec2f c = p0 - p1 * 2.5f + p2 * 2.0f - p3 * 0.5f;
+	Vec2f d = (p3 - p0) * 0.5f + (p1 - p2) * 1.5f;
+
+	// Evaluate SEGMENT_STEPS + 1 points, four at a time. The 
+	// arrays are padded to a multiple of four.
+	static const int32_t POINT_VECTORS = (SEGMENT_STEPS + 4) / 4;
+	__m128 x[POINT_VECTORS];
+	__m128 y[POINT_VECTORS];
+	__m128 step = _mm_set1_ps(1.0f / (float)SEGMENT_STEPS);
+	__m128 t = _mm_mul_ps(_mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), step);
+	__m128 tStep = _mm_mul_ps(_mm_set1_ps(4.0f), step);
+	for (int32_t i = 0; i < POINT_VECTORS; i++)
+	{
+
+		// Horner's rule
+		x[i] = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(d.x), t), _mm_set1_ps(c.x)), t), _mm_set1_ps(b.x)), t), _mm_set1_ps(a.x));
+		y[i] = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(d.y), t), _mm_set1_ps(c.y)), t), _mm_set1_ps(b.y)), t), _mm_set1_ps(a.y));
+		t = _mm_add_ps(t, tStep);
+
+	}
+
+	// Measure each step
+	const float * px = (const float *)x;
+	const float * py = (const float *)y;
+	__m128 lengths[SEGMENT_STEPS / 4];
+	for (int32_t i = 0; i < SEGMENT_STEPS / 4; i++)
+	{
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(px + i * 4 + 1), x[i]);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(py + i * 4 + 1), y[i]);
+		lengths[i] = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+	}
+
+	// Walk the steps, dropping a dab every time we've 
+	// covered the spacing distance
+	const float * length = (const float *)lengths;
+	for (int32_t i = 0; i < SEGMENT_STEPS; i++)
+	{
+		float travelled = 0.0f;
+		while (mRemaining <= length[i] - travelled)
+		{
+			travelled += mRemaining;
+			float u = travelled / length[i];
+			dabs.push_back(Vec2f(px[i] + (px[i + 1] - px[i]) * u, py[i] + (py[i + 1] - py[i]) * u));
+			mRemaining = mSpacing;
+		}
+		mRemaining -= length[i] - travelled;
+	}
+
+}
+
+// Ends a stroke
+void BrushStroke::end(vector<Vec2f> & dabs)
+{
+
+	// Bail if no stroke is in progress
+	if (!mActive)
+		return;
+
+	// Double the last point to draw the final segment
+	if (mControlCount > 2)
+		addPoint(mControl[mControlCount - 1], dabs);
+	mActive = false;
+	mControlCount = 0;
+
+}
+
+// Stroke is in progress
+bool BrushStroke::isActive() const
+{
+	return mActive;
+}
+
+// Set distance between dabs
+void BrushStroke::setSpacing(float spacing)
+{
+	mSpacing = math<float>::max(spacing, 1.0f);
+}
+
+// Adds samples to the stroke
+void BrushStroke::update(const vector<Vec2f> & points, vector<Vec2f> & dabs)
+{
+
+	// Bail if no stroke is in progress
+	if (!mActive)
+		return;
+
+	// Add each point, skipping any that haven't moved
+	// far enough to form a segment
+	for (vector<Vec2f>::const_iterator pointIt = points.begin(); pointIt != points.end(); ++pointIt)
+		if (pointIt->distanceSquared(mControl[mControlCount - 1]) >= 0.25f)
+			addPoint(* pointIt, dabs);
+
+}
+
+// Constructor
+StrokeReader::StrokeReader()
+{
+	mCanvasSize = Vec2i::zero();
+	mCount = 0;
+	mData = 0;
+	mSize = 0;
+#ifdef CINDER_MSW
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = 0;
+#else
+	mFile = -1;
+#endif
+}
+
+// Destructor
+StrokeReader::~StrokeReader()
+{
+	close();
+}
+
+// Unmap the file
+void StrokeReader::close()
+{
+
+	// Release the mapping and file
+#ifdef CINDER_MSW
+	if (mData != 0)
+		UnmapViewOfFile(mData);
+	if (mMapping != 0)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = 0;
+#else
+	if (mData != 0)
+		munmap((void *)mData, mSize);
+	if (mFile >= 0)
+		::close(mFile);
+	mFile = -1;
+#endif
+
+	// Reset properties
+	mCanvasSize = Vec2i::zero();
+	mCount = 0;
+	mData = 0;
+	mSize = 0;
+
+}
+
+// Canvas size when recorded
+const Vec2i & StrokeReader::getCanvasSize() const
+{
+	return mCanvasSize;
+}
+
+// Number of records
+size_t StrokeReader::getCount() const
+{
+	return mCount;
+}
+
+// Plays the recording into a stroke log
+void StrokeReader::getDabs(vector<BrushDab> & log) const
+{
+
+	// Strokes end at each end record, as they do in the 
+	// undo history. Undone strokes wait on a stack, and 
+	// a new stroke drops anything that could be redone.
+	log.clear();
+	vector<size_t> strokes;
+	vector<vector<BrushDab> > undone;
+	const StrokeRecord * records = getRecords();
+	for (size_t i = 0; i < mCount; i++)
+	{
+		const StrokeRecord & record = records[i];
+		if (record.mType == StrokeRecord::TYPE_DAB)
+		{
+			BrushDab dab;
+			dab.mX = record.mX;
+			dab.mY = record.mY;
+			dab.mSize = record.mSize;
+			log.push_back(dab);
+		}
+		else if (record.mType == StrokeRecord::TYPE_END)
+		{
+			size_t first = strokes.empty() ? 0 : strokes.back();
+			if (log.size() > first)
+			{
+				strokes.push_back(log.size());
+				undone.clear();
+			}
+		}
+		else if (record.mType == StrokeRecord::TYPE_CLEAR)
+		{
+			log.clear();
+			strokes.clear();
+			undone.clear();
+		}
+		else if (record.mType == StrokeRecord::TYPE_UNDO && !strokes.empty())
+		{
+			strokes.pop_back();
+			size_t first = strokes.empty() ? 0 : strokes.back();
+			undone.push_back(vector<BrushDab>(log.begin() + first, log.end()));
+			log.resize(first);
+		}
+		else if (record.mType == StrokeRecord::TYPE_REDO && !undone.empty())
+		{
+			log.insert(log.end(), undone.back().begin(), undone.back().end());
+			strokes.push_back(log.size());
+			undone.pop_back();
+		}
+	}
+
+}
+
+// Records follow the header
+const StrokeRecord * StrokeReader::getRecords() const
+{
+	return mCount > 0 ? (const StrokeRecord *)(mData + sizeof(StrokeHeader)) : 0;
+}
+
+// Map a recording
+bool StrokeReader::open(const fs::path & path)
+{
+
+	// Close the last file
+	close();
+
+	// Map the file
+#ifdef CINDER_MSW
+	mFile = CreateFileA(path.string().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, & size) || size.QuadPart < (LONGLONG)sizeof(StrokeHeader))
+	{
+		close();
+		return false;
+	}
+	mSize = (size_t)size.QuadPart;
+	mMapping = CreateFileMappingA(mFile, 0, PAGE_READONLY, 0, 0, 0);
+	if (mMapping != 0)
+		mData = (const uint8_t *)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	mFile = ::open(path.string().c_str(), O_RDONLY);
+	if (mFile < 0)
+		return false;
+	struct stat status;
+	if (fstat(mFile, & status) != 0 || status.st_size < (off_t)sizeof(StrokeHeader))
+	{
+		close();
+		return false;
+	}
+	mSize = (size_t)status.st_size;
+	void * data = mmap(0, mSize, PROT_READ, MAP_PRIVATE, mFile, 0);
+	if (data != MAP_FAILED)
+		mData = (const uint8_t *)data;
+#endif
+	if (mData == 0)
+	{
+		close();
+		return false;
+	}
+
+	// Check the header
+	const StrokeHeader * header = (const StrokeHeader *)mData;
+	if (memcmp(header->mMagic, "BRSH", 4) != 0 || header->mVersion != 1)
+	{
+		close();
+		return false;
+	}
+	mCanvasSize = Vec2i(header->mWidth, header->mHeight);
+	mCount = (mSize - sizeof(StrokeHeader)) / sizeof(StrokeRecord);
+	return true;
+
+}
+
+// Constructor
+StrokeRecorder::StrokeRecorder()
+{
+	mFile = 0;
+	mRunning = false;
+}
+
+// Destructor
+StrokeRecorder::~StrokeRecorder()
+{
+	close();
+}
+
+// Stop the writer thread and close the file
+void StrokeRecorder::close()
+{
+
+	// Bail if not open
+	if (mFile == 0)
+		return;
+
+	// Stop the writer. It writes what's left in the queue on its way out.
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_one();
+	mThread->join();
+	mThread.reset();
+
+	// Close the file
+	fclose(mFile);
+	mFile = 0;
+
+}
+
+// Wake the writer
+void StrokeRecorder::flush()
+{
+	mCondition.notify_one();
+}
+
+// File is open
+bool StrokeRecorder::isOpen() const
+{
+	return mFile != 0;
+}
+
+// Start a recording
+bool StrokeRecorder::open(const fs::path & path, const Vec2i & canvasSize)
+{
+
+	// Close the last file
+	close();
+
+	// Create the file and write the header
+	mFile = fopen(path.string().c_str(), "wb");
+	if (mFile == 0)
+		return false;
+	StrokeHeader header;
+	memcpy(header.mMagic, "BRSH", 4);
+	header.mVersion = 1;
+	header.mWidth = canvasSize.x;
+	header.mHeight = canvasSize.y;
+	fwrite(& header, sizeof(StrokeHeader), 1, mFile);
+	fflush(mFile);
+
+	// Start the writer
+	mQueue.clear();
+	mRunning = true;
+	mThread = shared_ptr<thread>(new thread(std::bind(& StrokeRecorder::run, this)));
+	return true;
+
+}
+
+// Writer thread. Swaps out the queue and writes it,
+// so the lock is never held during a write.
+void StrokeRecorder::run()
+{
+
+	// Write until stopped
+	vector<StrokeRecord> records;
+	bool running = true;
+	while (running)
+	{
+
+		// Wait for records
+		{
+			unique_lock<mutex> lock(mMutex);
+			while (mQueue.empty() && mRunning)
+				mCondition.wait(lock);
+			records.swap(mQueue);
+			running = mRunning;
+		}
+
+		// Append them to the file
+		if (!records.empty())
+		{
+			fwrite(& records[0], sizeof(StrokeRecord), records.size(), mFile);
+			fflush(mFile);
+			records.clear();
+		}
+
+	}
+
+}
+
+// Queue a record
+void StrokeRecorder::write(const StrokeRecord & record)
+{
+	if (mFile == 0)
+		return;
+	lock_guard<mutex> lock(mMutex);
+	mQueue.push_back(record);
+}
+
+// Constructor
+TileHistory::TileHistory()
+{
+	mBudget = 64 * 1024 * 1024;
+	mByteCount = 0;
+	mColumns = 0;
+	mPosition = 0;
+	mReadbackIndex = 0;
+	mRecording = false;
+	mRecordIndex = 0;
+	mResumed = false;
+	mRows = 0;
+	mSize = Vec2i::zero();
+	for (int32_t i = 0; i < READBACK_COUNT; i++)
+		mReadbacks[i].mPending = false;
+}
+
+// Starts recording a stroke
+void TileHistory::begin(size_t firstDab)
+{
+
+	// A new stroke drops anything we could have redone
+	while (mStrokes.size() > mPosition)
+	{
+		mByteCount -= getByteCount(mStrokes.back());
+		mStrokes.pop_back();
+	}
+
+	// Open the stroke
+	Stroke stroke;
+	stroke.mCompressed = false;
+	stroke.mFirstDab = firstDab;
+	stroke.mLastDab = firstDab;
+	stroke.mValid = true;
+	mStrokes.push_back(stroke);
+	mPosition = mStrokes.size();
+	mRecording = true;
+	mRecordIndex = mStrokes.size() - 1;
+	mResumed = false;
+
+}
+
+// Clear history
+void TileHistory::clear()
+{
+	mByteCount = 0;
+	mPosition = 0;
+	mRecording = false;
+	mStrokes.clear();
+	std::fill(mTileSaved.begin(), mTileSaved.end(), 0);
+	for (int32_t i = 0; i < READBACK_COUNT; i++)
+	{
+		mReadbacks[i].mPending = false;
+		if (mReadbacks[i].mPbo)
+			mReadbacks[i].mPbo.reset();
+	}
+}
+
+// Run-length encodes a tile, if it makes it smaller
+void TileHistory::compress(Tile & tile)
+{
+
+	// Bail if already compressed
+	if (tile.mCompressed)
+		return;
+
+	// Encode runs of identical pixels
+	mScratch.clear();
+	size_t count = tile.mPixels.size();
+	for (size_t i = 0; i < count; )
+	{
+		size_t run = 1;
+		while (i + run < count && tile.mPixels[i + run] == tile.mPixels[i])
+			run++;
+		mScratch.push_back((uint32_t)run);
+		mScratch.push_back(tile.mPixels[i]);
+		i += run;
+	}
+
+	// Keep the encoded pixels if they're smaller
+	if (mScratch.size() < count)
+	{
+		tile.mCompressed = true;
+		tile.mPixels.assign(mScratch.begin(), mScratch.end());
+	}
+
+}
+
+// Finishes recording a stroke
+void TileHistory::end(gl::Fbo & canvas, size_t lastDab)
+{
+
+	// Bail if not recording
+	if (!mRecording)
+		return;
+
+	// Save the tiles as they look after the stroke, 
+	// and reset the touched flags for the next one
+	Stroke & stroke = mStrokes[mRecordIndex];
+	stroke.mLastDab = lastDab;
+	stroke.mAfter.resize(stroke.mBefore.size());
+	for (size_t i = 0; i < stroke.mBefore.size(); i++)
+	{
+		readTile(canvas, stroke.mBefore[i].mIndex, true, i);
+		mTileSaved[stroke.mBefore[i].mIndex] = 0;
+	}
+
+	// Wait for the tiles still in flight. This is the 
+	// only time the stroke waits on the GPU.
+	for (int32_t i = 0; i < READBACK_COUNT; i++)
+		finishReadback(mReadbacks[i]);
+	mRecording = false;
+	stroke.mValid = true;
+
+	// Drop the stroke if it painted nothing
+	if (!mResumed && stroke.mFirstDab == stroke.mLastDab)
+	{
+		mStrokes.pop_back();
+		mPosition = mStrokes.size();
+		return;
+	}
+
+	// Stay within budget. Trimming can drop the oldest 
+	// strokes, so strokes being saved again wait for
+	// the last one in the log.
+	mByteCount += getByteCount(stroke);
+	if (!mResumed || mRecordIndex + 1 >= mPosition)
+		trim();
+
+}
+
+// Copies a tile out of its pixel buffer
+void TileHistory::finishReadback(Readback & readback)
+{
+
+	// Bail if there's nothing in the buffer
+	if (!readback.mPending)
+		return;
+	readback.mPending = false;
+
+	// Copy the pixels into the tile
+	Stroke & stroke = mStrokes[mRecordIndex];
+	Tile & tile = readback.mAfter ? stroke.mAfter[readback.mTile] : stroke.mBefore[readback.mTile];
+	readback.mPbo.bind();
+	const uint8_t * pixels = (const uint8_t *)readback.mPbo.map(GL_READ_ONLY);
+	if (pixels != 0)
+	{
+		memcpy(& tile.mPixels[0], pixels, tile.mPixels.size() * sizeof(uint32_t));
+		readback.mPbo.unmap();
+	}
+	readback.mPbo.unbind();
+
+}
+
+// Memory used by a stroke
+size_t TileHistory::getByteCount(const Stroke & stroke)
+{
+	size_t byteCount = stroke.mDabs.size() * sizeof(BrushDab);
+	for (vector<Tile>::const_iterator tileIt = stroke.mBefore.begin(); tileIt != stroke.mBefore.end(); ++tileIt)
+		byteCount += tileIt->mPixels.size() * sizeof(uint32_t);
+	for (vector<Tile>::const_iterator tileIt = stroke.mAfter.begin(); tileIt != stroke.mAfter.end(); ++tileIt)
+		byteCount += tileIt->mPixels.size() * sizeof(uint32_t);
+	return byteCount;
+}
+
+// Memory used by the history
+size_t TileHistory::getByteCount() const
+{
+	return mByteCount;
+}
+
+// Dabs in the log that belong to a stroke
+void TileHistory::getDabRange(size_t index, size_t & firstDab, size_t & lastDab) const
+{
+	firstDab = mStrokes[index].mFirstDab;
+	lastDab = mStrokes[index].mLastDab;
+}
+
+// Strokes that can be undone
+size_t TileHistory::getStrokeCount() const
+{
+	return mPosition;
+}
+
+// Pixel area covered by a tile, clipped to the canvas
+Area TileHistory::getTileArea(int32_t index) const
+{
+	int32_t x = (index % mColumns) * TILE_SIZE;
+	int32_t y = (index / mColumns) * TILE_SIZE;
+	return Area(x, y, math<int32_t>::min(x + TILE_SIZE, mSize.x), math<int32_t>::min(y + TILE_SIZE, mSize.y));
+}
+
+// Drops saved tiles after the canvas changes
+void TileHistory::invalidate(const Vec2i & size)
+{
+
+	// Resize the tile grid
+	mSize = size;
+	mColumns = (size.x + TILE_SIZE - 1) / TILE_SIZE;
+	mRows = (size.y + TILE_SIZE - 1) / TILE_SIZE;
+	mTileSaved.assign(mColumns * mRows, 0);
+
+	// Strokes keep only their dabs until they're saved again.
+	// Tiles still being read back belong to the old canvas.
+	mByteCount = 0;
+	mRecording = false;
+	for (int32_t i = 0; i < READBACK_COUNT; i++)
+		mReadbacks[i].mPending = false;
+	for (deque<Stroke>::iterator strokeIt = mStrokes.begin(); strokeIt != mStrokes.end(); ++strokeIt)
+	{
+		strokeIt->mAfter.clear();
+		strokeIt->mBefore.clear();
+		strokeIt->mCompressed = false;
+		strokeIt->mValid = false;
+		mByteCount += getByteCount(* strokeIt);
+	}
+
+}
+
+// Stroke is being recorded
+bool TileHistory::isRecording() const
+{
+	return mRecording;
+}
+
+// Starts reading a tile from the canvas into the recording 
+// stroke's "before" or "after" list
+void TileHistory::readTile(gl::Fbo & canvas, int32_t index, bool after, size_t tile)
+{
+
+	// Size the tile
+	Area area = getTileArea(index);
+	Tile & target = after ? mStrokes[mRecordIndex].mAfter[tile] : mStrokes[mRecordIndex].mBefore[tile];
+	target.mCompressed = false;
+	target.mIndex = index;
+	target.mPixels.resize(area.getWidth() * area.getHeight());
+
+	// Take the next buffer in the ring, finishing 
+	// the tile it was reading first
+	Readback & readback = mReadbacks[mReadbackIndex];
+	mReadbackIndex = (mReadbackIndex + 1) % READBACK_COUNT;
+	finishReadback(readback);
+	if (!readback.mPbo)
+	{
+		readback.mPbo = gl::Vbo(GL_PIXEL_PACK_BUFFER_ARB);
+		readback.mPbo.bind();
+		readback.mPbo.bufferData(TILE_SIZE * TILE_SIZE * sizeof(uint32_t), 0, GL_STREAM_READ);
+	}
+	else
+	{
+		readback.mPbo.bind();
+	}
 
-/*
- * This application demonstrates the basics of how
- * to load and configure a geometry shader. It converts 
- * points to shapes generated in GLSL.
- */
+	// Start the copy. The read is queued behind any drawing
+	// already sent, so it sees the canvas as it is now.
+	canvas.bindFramebuffer();
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(area.x1, area.y1, area.getWidth(), area.getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	canvas.unbindFramebuffer();
+	readback.mPbo.unbind();
+	readback.mAfter = after;
+	readback.mPending = true;
+	readback.mTile = tile;
 
-// GPU box mesh
-class BrushApp : public ci::app::AppBasic 
+}
+
+// Redo the next stroke
+bool TileHistory::redo(gl::Fbo & canvas, vector<BrushDab> & log, bool & repaint)
 {
 
-public:
+	// Bail if there's nothing to redo
+	repaint = false;
+	if (mRecording || mPosition >= mStrokes.size())
+		return false;
+
+	// Move the dabs back into the log
+	Stroke & stroke = mStrokes[mPosition++];
+	mByteCount -= stroke.mDabs.size() * sizeof(BrushDab);
+	stroke.mFirstDab = log.size();
+	log.insert(log.end(), stroke.mDabs.begin(), stroke.mDabs.end());
+	stroke.mLastDab = log.size();
+	stroke.mDabs.clear();
+
+	// Restore the painted tiles
+	if (stroke.mValid)
+		for (vector<Tile>::const_iterator tileIt = stroke.mAfter.begin(); tileIt != stroke.mAfter.end(); ++tileIt)
+			writeTile(canvas, * tileIt);
+	else
+		repaint = true;
+	return true;
 
-	// Cinder callbacks
-	void draw();
-	void mouseDrag(ci::app::MouseEvent event);
-	void prepareSettings(ci::app::AppBasic::Settings * settings);
-	void resize(ci::app::ResizeEvent event);
-	void setup();
-	void shutdown();
-	void update();
+}
 
-private:
+// Start saving a stroke's tiles again
+void TileHistory::resume(size_t index)
+{
 
-	// Brush
-	float mSize;
-	ci::gl::Texture mTexture;
-	bool mTransform;
-	bool mTransformPrev;
+	// Bail if recording or the stroke isn't in the log
+	if (mRecording || index >= mPosition)
+		return;
+
+	// Drop anything left of its old tiles
+	Stroke & stroke = mStrokes[index];
+	mByteCount -= getByteCount(stroke);
+	stroke.mAfter.clear();
+	stroke.mBefore.clear();
+	stroke.mCompressed = false;
+	stroke.mValid = false;
+	mByteCount += getByteCount(stroke);
+	mRecording = true;
+	mRecordIndex = index;
+	mResumed = true;
 
-	// Point list
-	void clearPoints();
-	std::vector<ci::Vec2f> mPoints;
+}
 
-	// Shader
-	void loadShader();
-	double mGlslVersion;
-	ci::gl::GlslProg mShader;
-	ci::gl::GlslProg mShaderPassThru;
-	ci::gl::GlslProg mShaderTransform;
-	
-	// Window
-	float mElapsedFrames;
-	float mElapsedSeconds;
-	float mFrameRate;
-	bool mFullScreen;
-	bool mFullScreenPrev;
+// Set memory budget
+void TileHistory::setBudget(size_t bytes)
+{
+	mBudget = bytes;
+	trim();
+}
 
-	// Debug
-	ci::params::InterfaceGl mParams;
-	void screenShot();
-	void trace(const std::string & message);
+// Saves tiles under an area before it's painted
+void TileHistory::touch(gl::Fbo & canvas, const Area & area)
+{
 
-};
+	// Bail if not recording
+	if (!mRecording || mColumns <= 0 || mRows <= 0)
+		return;
 
-// Import namespaces
-using namespace ci;
-using namespace ci::app;
-using namespace std;
+	// Find the tiles under the area
+	int32_t x1 = math<int32_t>::clamp(area.x1 / TILE_SIZE, 0, mColumns - 1);
+	int32_t y1 = math<int32_t>::clamp(area.y1 / TILE_SIZE, 0, mRows - 1);
+	int32_t x2 = math<int32_t>::clamp(area.x2 / TILE_SIZE, 0, mColumns - 1);
+	int32_t y2 = math<int32_t>::clamp(area.y2 / TILE_SIZE, 0, mRows - 1);
+
+	// Save tiles the first time this stroke touches them
+	Stroke & stroke = mStrokes[mRecordIndex];
+	for (int32_t y = y1; y <= y2; y++)
+		for (int32_t x = x1; x <= x2; x++)
+		{
+			int32_t index = y * mColumns + x;
+			if (mTileSaved[index] == 0)
+			{
+				mTileSaved[index] = 1;
+				stroke.mBefore.push_back(Tile());
+				readTile(canvas, index, false, stroke.mBefore.size() - 1);
+			}
+		}
+
+}
+
+// Keeps the history within its budget
+void TileHistory::trim()
+{
+
+	// The recording stroke is trimmed when it ends
+	if (mRecording)
+		return;
+
+	// Compress the oldest strokes first. The
+	// last stroke stays raw for a fast undo.
+	for (size_t i = 0; i + 1 < mStrokes.size() && mByteCount > mBudget; i++)
+	{
+		Stroke & stroke = mStrokes[i];
+		if (!stroke.mCompressed)
+		{
+			mByteCount -= getByteCount(stroke);
+			for (vector<Tile>::iterator tileIt = stroke.mBefore.begin(); tileIt != stroke.mBefore.end(); ++tileIt)
+				compress(* tileIt);
+			for (vector<Tile>::iterator tileIt = stroke.mAfter.begin(); tileIt != stroke.mAfter.end(); ++tileIt)
+				compress(* tileIt);
+			stroke.mCompressed = true;
+			mByteCount += getByteCount(stroke);
+		}
+	}
+
+	// Then forget the oldest strokes. Strokes waiting
+	// to be redone go first, newest to oldest.
+	while (mStrokes.size() > 1 && mByteCount > mBudget)
+	{
+		if (mPosition > 0 && mPosition == mStrokes.size())
+		{
+			mByteCount -= getByteCount(mStrokes.front());
+			mStrokes.pop_front();
+			mPosition--;
+		}
+		else
+		{
+			mByteCount -= getByteCount(mStrokes.back());
+			mStrokes.pop_back();
+		}
+	}
+
+}
+
+// Undo the last stroke
+bool TileHistory::undo(gl::Fbo & canvas, vector<BrushDab> & log, bool & replay)
+{
+
+	// Bail if there's nothing to undo
+	replay = false;
+	if (mRecording || mPosition == 0)
+		return false;
+
+	// Move the stroke's dabs out of the log. Strokes
+	// are undone in order, so they're at the end.
+	Stroke & stroke = mStrokes[--mPosition];
+	stroke.mDabs.assign(log.begin() + stroke.mFirstDab, log.begin() + stroke.mLastDab);
+	log.erase(log.begin() + stroke.mFirstDab, log.begin() + stroke.mLastDab);
+	mByteCount += stroke.mDabs.size() * sizeof(BrushDab);
+
+	// Restore the tiles from before the stroke
+	if (stroke.mValid)
+		for (vector<Tile>::const_iterator tileIt = stroke.mBefore.begin(); tileIt != stroke.mBefore.end(); ++tileIt)
+			writeTile(canvas, * tileIt);
+	else
+		replay = true;
+	return true;
+
+}
+
+// Copies a tile into the canvas
+void TileHistory::writeTile(gl::Fbo & canvas, const Tile & tile)
+{
+
+	// Decode the tile if needed
+	const uint32_t * pixels = & tile.mPixels[0];
+	if (tile.mCompressed)
+	{
+		mScratch.clear();
+		for (size_t i = 0; i + 1 < tile.mPixels.size(); i += 2)
+			mScratch.insert(mScratch.end(), tile.mPixels[i], tile.mPixels[i + 1]);
+		pixels = & mScratch[0];
+	}
+
+	// Upload it
+	Area area = getTileArea(tile.mIndex);
+	gl::Texture & texture = canvas.getTexture();
+	texture.bind();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(texture.getTarget(), 0, area.x1, area.y1, area.getWidth(), area.getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	texture.unbind();
+
+}
+
+// Moves interpolated dabs into the stroke log
+void BrushApp::addDabs()
+{
+
+	// Dab size is stored in the log's normalized form
+	uint16_t size = (uint16_t)(math<float>::clamp(mSize, 0.0f, 1.0f) * 65535.0f);
+	for (vector<Vec2f>::const_iterator dabIt = mStrokeDabs.begin(); dabIt != mStrokeDabs.end(); ++dabIt)
+	{
+		BrushDab dab;
+		dab.mX = (int16_t)math<float>::clamp(dabIt->x, -32768.0f, 32767.0f);
+		dab.mY = (int16_t)math<float>::clamp(dabIt->y, -32768.0f, 32767.0f);
+		dab.mSize = size;
+		mStrokeLog.push_back(dab);
+		record(StrokeRecord::TYPE_DAB, dab.mX, dab.mY, dab.mSize);
+	}
+	mStrokeDabs.clear();
+	mDabCount = (int32_t)mStrokeLog.size();
+
+}
 
 // Renders the scene
 void BrushApp::draw()
 {
 
+	// Paint any dabs added since the last frame into the canvas
+	if (mCanvasDabCount < mStrokeLog.size())
+	{
+
+		// Start recording a stroke for undo
+		if (!mHistory.isRecording())
+			mHistory.begin(mCanvasDabCount);
+
+		// Save the tiles under the new dabs, then paint them
+		touchDabs(mCanvasDabCount, mStrokeLog.size());
+		drawDabs(mCanvasDabCount, mStrokeLog.size());
+		mCanvasDabCount = mStrokeLog.size();
+
+	}
+
+	// Save the painted tiles when the stroke is done
+	if (mHistory.isRecording() && !mStroke.isActive() && !mReplayStroke)
+	{
+		mHistory.end(mCanvas, mStrokeLog.size());
+		record(StrokeRecord::TYPE_END);
+	}
+
 	// Set up scene
 	gl::clear(ColorAf::black(), true);
 	gl::setViewport(getWindowBounds());
 	gl::setMatricesWindow(getWindowSize());
 
+	// Draw the canvas. It already holds the blended result,
+	// so we copy it to the screen without blending.
+	gl::disableAlphaBlending();
+	gl::draw(mCanvas.getTexture(), getWindowBounds());
+	gl::enableAdditiveBlending();
+
+	// Compare the print with the window before 
+	// the params are drawn over it
+	if (mVerifyPrint)
+	{
+		comparePrint(copyWindowSurface());
+		mVerifyPrint = false;
+	}
+
+	// Draw the params interface
+	params::InterfaceGl::draw();
+
+}
+
+// Clear the canvas and stroke log
+void BrushApp::clearCanvas()
+{
+
+	// Clear history
+	record(StrokeRecord::TYPE_CLEAR);
+	mHistory.clear();
+	mStrokeLog.clear();
+	mCanvasDabCount = 0;
+	mDabCount = 0;
+
+	// Clear the canvas
+	mCanvas.bindFramebuffer();
+	gl::clear(ColorAf::black(), true);
+	mCanvas.unbindFramebuffer();
+
+}
+
+// Renders the stroke log at window size and reports how 
+// far it is from what the GPU drew
+void BrushApp::comparePrint(const Surface8u & window)
+{
+
+	// Render the print in the current brush mode
+	int32_t width = window.getWidth();
+	int32_t height = window.getHeight();
+	Surface8u print(width, height, true, SurfaceChannelOrder::RGBA);
+	mCompositor.render(mStrokeLog.empty() ? 0 : & mStrokeLog[0], mStrokeLog.size(), getWindowSize(), mTransform, print);
+
+	// Compare color channels. The window may not have alpha.
+	int32_t windowIncrement = window.getPixelInc();
+	int32_t windowOffsets[3] = { window.getRedOffset(), window.getGreenOffset(), window.getBlueOffset() };
+	int32_t printOffsets[3] = { print.getRedOffset(), print.getGreenOffset(), print.getBlueOffset() };
+	int32_t maxError = 0;
+	uint64_t totalError = 0;
+	for (int32_t y = 0; y < height; y++)
+	{
+		const uint8_t * windowRow = window.getData() + (size_t)y * window.getRowBytes();
+		const uint8_t * printRow = print.getData() + (size_t)y * print.getRowBytes();
+		for (int32_t x = 0; x < width; x++)
+			for (int32_t c = 0; c < 3; c++)
+			{
+				int32_t error = math<int32_t>::abs((int32_t)windowRow[x * windowIncrement + windowOffsets[c]] - (int32_t)printRow[x * 4 + printOffsets[c]]);
+				maxError = math<int32_t>::max(maxError, error);
+				totalError += (uint64_t)error;
+			}
+	}
+
+	// Report error in 8 bit levels
+	double meanError = (double)totalError / math<double>::max((double)width * (double)height * 3.0, 1.0);
+	trace("Print vs window (" + string(mTransform ? "transform" : "pass-thru") + ", " + toString(mStrokeLog.size()) + " dabs): max error " + toString(maxError) + ", mean error " + toString(meanError));
+
+}
+
+// Paints dabs from the stroke log into the canvas
+void BrushApp::drawDabs(size_t first, size_t last)
+{
+
+	// Bail if there's nothing to draw
+	if (first >= last)
+		return;
+
+	// Set up the canvas as the render target
+	mCanvas.bindFramebuffer();
+	gl::setViewport(mCanvas.getBounds());
+	gl::setMatricesWindow(mCanvas.getSize(), false);
+
 	// Bind brush texture
 	mTexture.bind(0);
 
 	// Bind and configure shader
 	mShader.bind();
 	mShader.uniform("aspect", getWindowAspectRatio());
-	mShader.uniform("size", mSize);
 	mShader.uniform("tex", 0);
 	mShader.uniform("transform", mTransform);
 
-	// Draw points
-	glBegin(GL_POINTS);
-	for (vector<Vec2f>::const_iterator pointIt = mPoints.cbegin(); pointIt != mPoints.cend(); ++pointIt)
-		gl::vertex(* pointIt);
-	glEnd();
+	// The stroke log is already laid out as a vertex array,
+	// so we can point GL right at it and draw in one call
+	GLint sizeLocation = mShader.getAttribLocation("dabSize");
+	GLsizei stride = (GLsizei)sizeof(BrushDab);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_SHORT, stride, & mStrokeLog[first].mX);
+	if (sizeLocation >= 0)
+	{
+		glEnableVertexAttribArray(sizeLocation);
+		glVertexAttribPointer(sizeLocation, 1, GL_UNSIGNED_SHORT, GL_TRUE, stride, & mStrokeLog[first].mSize);
+	}
+	glDrawArrays(GL_POINTS, 0, (GLsizei)(last - first));
+	if (sizeLocation >= 0)
+		glDisableVertexAttribArray(sizeLocation);
+	glDisableClientState(GL_VERTEX_ARRAY);
 
 	// Unbind shader drawing
 	mShader.unbind();
@@ -98,15 +1794,71 @@ void BrushApp::draw()
 	// Unbind brush texture
 	mTexture.unbind();
 
-	// Draw the params interface
-	params::InterfaceGl::draw();
+	// Stop drawing to the canvas
+	mCanvas.unbindFramebuffer();
+
+}
+
+// Renders the stroke log at print resolution
+void BrushApp::exportPrint()
+{
+
+	// Keep the window's aspect ratio
+	int32_t width = mExportWidth;
+	int32_t height = (int32_t)((float)width * (float)getWindowHeight() / (float)getWindowWidth() + 0.5f);
+
+	// Render on the CPU
+	Timer timer;
+	timer.start();
+	Surface8u surface(width, height, true, SurfaceChannelOrder::RGBA);
+	mCompositor.render(mStrokeLog.empty() ? 0 : & mStrokeLog[0], mStrokeLog.size(), getWindowSize(), mTransform, surface);
+	timer.stop();
+	trace("Rendered " + toString(mStrokeLog.size()) + " dabs at " + toString(width) + "x" + toString(height) + " in " + toString(timer.getSeconds() * 1000.0) + "ms");
+
+	// Save PNG to application directory
+	writeImage(fs::path(getAppPath().generic_string() + "print" + toString(getElapsedFrames()) + ".png"), surface);
 
 }
 
-// Clear point list
-void BrushApp::clearPoints()
+// Creates the canvas at the window's size and repaints 
+// the stroke log into it
+void BrushApp::initCanvas()
 {
-	mPoints.clear();
+
+	// Create the canvas
+	gl::Fbo::Format format;
+	format.enableDepthBuffer(false);
+	mCanvas = gl::Fbo(getWindowWidth(), getWindowHeight(), format);
+
+	// Saved undo tiles don't survive a new canvas
+	mHistory.invalidate(getWindowSize());
+
+	// Clear it
+	mCanvas.bindFramebuffer();
+	gl::clear(ColorAf::black(), true);
+	mCanvas.unbindFramebuffer();
+
+	// Repaint history. Strokes that can be undone are painted 
+	// one at a time so their tiles are saved again, and undo
+	// never has to replay the log.
+	size_t painted = 0;
+	for (size_t i = 0; i < mHistory.getStrokeCount(); i++)
+	{
+		size_t first = 0;
+		size_t last = 0;
+		mHistory.getDabRange(i, first, last);
+		if (first >= last)
+			continue;
+		drawDabs(painted, first);
+		mHistory.resume(i);
+		touchDabs(first, last);
+		drawDabs(first, last);
+		mHistory.end(mCanvas, last);
+		painted = last;
+	}
+	drawDabs(painted, mStrokeLog.size());
+	mCanvasDabCount = mStrokeLog.size();
+
 }
 
 // Load GLSL shaders from resources
@@ -176,12 +1928,38 @@ void BrushApp::loadShader()
 
 }
 
+// Handles mouse down
+void BrushApp::mouseDown(ci::app::MouseEvent event)
+{
+
+	// Ignore the mouse while replaying
+	if (mReplaying)
+		return;
+
+	// Start a stroke. Brush size sets the dab spacing.
+	mStroke.setSpacing(mSize * mSpacing * (float)getWindowWidth() * 0.7071f);
+	mStroke.begin(Vec2f((float)event.getPos().x, (float)event.getPos().y), mStrokeDabs);
+
+}
+
 // Handles mouse drag
 void BrushApp::mouseDrag(ci::app::MouseEvent event)
 {
 
-	// Add a brush
-	mPoints.push_back(Vec2f((float)event.getPos().x, (float)event.getPos().y));
+	// Collect the sample. Samples are turned into 
+	// dabs in a batch on the next update.
+	mStrokeSamples.push_back(Vec2f((float)event.getPos().x, (float)event.getPos().y));
+
+}
+
+// Handles mouse up
+void BrushApp::mouseUp(ci::app::MouseEvent event)
+{
+
+	// Flush pending samples and finish the stroke
+	mStroke.update(mStrokeSamples, mStrokeDabs);
+	mStrokeSamples.clear();
+	mStroke.end(mStrokeDabs);
 
 }
 
@@ -189,6 +1967,17 @@ void BrushApp::mouseDrag(ci::app::MouseEvent event)
 void BrushApp::prepareSettings(ci::app::AppBasic::Settings * settings)
 {
 
+	// Print a recording and exit before a window is opened
+	// when run as "BrushApp --print <file> [width] [--pass-thru]"
+	const vector<string> & args = getArgs();
+	for (size_t i = 0; i + 1 < args.size(); i++)
+		if (args[i] == "--print")
+		{
+			int32_t width = i + 2 < args.size() && args[i + 2] != "--pass-thru" ? fromString<int32_t>(args[i + 2]) : 8192;
+			bool transform = find(args.begin(), args.end(), "--pass-thru") == args.end();
+			exit(printRecording(fs::path(args[i + 1]), width, transform) ? 0 : 1);
+		}
+
 	// Set up window
 	settings->setTitle("BrushApp");
 	settings->setWindowSize(1024, 600);
@@ -197,6 +1986,176 @@ void BrushApp::prepareSettings(ci::app::AppBasic::Settings * settings)
 
 }
 
+// Renders a recording to a PNG beside it. This runs before
+// the window is created, so nothing here may touch GL.
+bool BrushApp::printRecording(const fs::path & path, int32_t width, bool transform)
+{
+
+	// Play the recording into a stroke log
+	StrokeReader reader;
+	if (!reader.open(path))
+	{
+		trace("Unable to open recording " + path.string());
+		return false;
+	}
+	vector<BrushDab> log;
+	reader.getDabs(log);
+	Vec2i canvasSize = reader.getCanvasSize();
+	reader.close();
+	if (canvasSize.x <= 0 || canvasSize.y <= 0 || width <= 0)
+	{
+		trace("Invalid print size");
+		return false;
+	}
+
+	// Load brush
+	mCompositor.setBrush(Surface8u(loadImage(loadResource(RES_IMAGE_BRUSH))));
+
+	// Render at the recording's aspect ratio
+	int32_t height = (int32_t)((float)width * (float)canvasSize.y / (float)canvasSize.x + 0.5f);
+	Timer timer;
+	timer.start();
+	Surface8u surface(width, height, true, SurfaceChannelOrder::RGBA);
+	mCompositor.render(log.empty() ? 0 : & log[0], log.size(), canvasSize, transform, surface);
+	timer.stop();
+	trace("Rendered " + toString(log.size()) + " dabs at " + toString(width) + "x" + toString(height) + " in " + toString(timer.getSeconds() * 1000.0) + "ms");
+
+	// Save PNG
+	fs::path output = path;
+	output.replace_extension(".png");
+	writeImage(output, surface);
+	trace("Saved " + output.string());
+	return true;
+
+}
+
+// Adds an event to the session recording
+void BrushApp::record(uint16_t type, int16_t x, int16_t y, uint16_t size)
+{
+
+	// Start the recording with the first dab. Nothing 
+	// before it changes the canvas, so it's skipped.
+	if (!mRecorder.isOpen())
+	{
+		if (!mRecordSession || type != StrokeRecord::TYPE_DAB)
+			return;
+		fs::path path = fs::path(getAppPath().generic_string() + "session" + toString((uint64_t)time(0)) + ".brsh");
+		if (!mRecorder.open(path, getWindowSize()))
+		{
+			trace("Unable to record to " + path.string());
+			mRecordSession = false;
+			return;
+		}
+	}
+
+	// Queue the record
+	StrokeRecord record;
+	record.mTime = (uint32_t)(getElapsedSeconds() * 1000.0);
+	record.mType = type;
+	record.mX = x;
+	record.mY = y;
+	record.mSize = size;
+	mRecorder.write(record);
+
+}
+
+// Redo the last undone stroke
+void BrushApp::redo()
+{
+
+	// Restore the stroke. If its saved tiles are out of 
+	// date, paint its dabs and save them again.
+	bool repaint = false;
+	size_t first = mCanvasDabCount;
+	if (mHistory.redo(mCanvas, mStrokeLog, repaint))
+	{
+		if (repaint)
+		{
+			mHistory.resume(mHistory.getStrokeCount() - 1);
+			touchDabs(first, mStrokeLog.size());
+			drawDabs(first, mStrokeLog.size());
+			mHistory.end(mCanvas, mStrokeLog.size());
+		}
+		mCanvasDabCount = mStrokeLog.size();
+		record(StrokeRecord::TYPE_REDO);
+	}
+
+}
+
+// Plays back records from the open recording, up to the current
+// replay time. Dabs go straight into the stroke log. A stroke's
+// end, and anything that needs a fully painted canvas, waits for
+// the next frame.
+void BrushApp::replay()
+{
+
+	// Find the current replay time in the recording. A 
+	// speed of zero plays as fast as the canvas can draw.
+	const StrokeRecord * records = mReader.getRecords();
+	size_t count = mReader.getCount();
+	double time = mReplaySpeed > 0.0f ? (getElapsedSeconds() - mReplayStart) * 1000.0 * (double)mReplaySpeed : 0.0;
+	if (mReplayIndex < count)
+		time += (double)records[0].mTime;
+
+	// Play records
+	while (mReplayIndex < count)
+	{
+
+		// Stop at the current time
+		const StrokeRecord & record = records[mReplayIndex];
+		if (mReplaySpeed > 0.0f && (double)record.mTime > time)
+			break;
+
+		// Add dabs to the log
+		if (record.mType == StrokeRecord::TYPE_DAB)
+		{
+			BrushDab dab;
+			dab.mX = record.mX;
+			dab.mY = record.mY;
+			dab.mSize = record.mSize;
+			mStrokeLog.push_back(dab);
+			this->record(StrokeRecord::TYPE_DAB, dab.mX, dab.mY, dab.mSize);
+			mReplayStroke = true;
+		}
+		else if (record.mType == StrokeRecord::TYPE_END)
+		{
+
+			// Let the stroke paint and close its undo record
+			mReplayStroke = false;
+			mReplayIndex++;
+			break;
+
+		}
+		else
+		{
+
+			// Clear, undo, and redo need the canvas up to date
+			if (mCanvasDabCount < mStrokeLog.size() || mHistory.isRecording())
+				break;
+			if (record.mType == StrokeRecord::TYPE_CLEAR)
+				clearCanvas();
+			else if (record.mType == StrokeRecord::TYPE_REDO)
+				redo();
+			else if (record.mType == StrokeRecord::TYPE_UNDO)
+				undo();
+
+		}
+		mReplayIndex++;
+
+	}
+
+	// Finish
+	if (mReplayIndex >= count)
+	{
+		mReplaying = false;
+		mReplayStroke = false;
+		double elapsed = getElapsedSeconds() - mReplayStart;
+		trace("Replayed " + toString(count) + " records in " + toString(elapsed * 1000.0) + "ms (" + toString((double)count / math<double>::max(elapsed, 0.001)) + " records/s)");
+		mReader.close();
+	}
+
+}
+
 // Handles window resize event
 void BrushApp::resize(ResizeEvent event)
 {
@@ -212,6 +2171,9 @@ void BrushApp::resize(ResizeEvent event)
 	glPointSize(3.0f);
 	gl::color(ColorAf::white());
 
+	// Resize the canvas
+	initCanvas();
+
 }
 
 // Take screen shot
@@ -223,6 +2185,34 @@ void BrushApp::screenShot()
 
 }
 
+// Opens a recording and starts replaying it
+void BrushApp::startReplay()
+{
+
+	// Choose a recording
+	fs::path path = getOpenFilePath(getAppPath());
+	if (path.empty())
+		return;
+	if (!mReader.open(path))
+	{
+		trace("Unable to open recording " + path.string());
+		return;
+	}
+	if (mReader.getCanvasSize() != getWindowSize())
+		trace("Recording was made at " + toString(mReader.getCanvasSize().x) + "x" + toString(mReader.getCanvasSize().y));
+
+	// Start from an empty canvas
+	mStroke.end(mStrokeDabs);
+	mStrokeDabs.clear();
+	mStrokeSamples.clear();
+	clearCanvas();
+	mReplayIndex = 0;
+	mReplaying = true;
+	mReplayStart = getElapsedSeconds();
+	mReplayStroke = false;
+
+}
+
 // Set up
 void BrushApp::setup()
 {
@@ -231,20 +2221,52 @@ void BrushApp::setup()
 	loadShader();
 
 	// Load brush
-	mTexture = gl::Texture(loadImage(loadResource(RES_IMAGE_BRUSH)));
+	mBrush = Surface8u(loadImage(loadResource(RES_IMAGE_BRUSH)));
+	mTexture = gl::Texture(mBrush);
+	mCompositor.setBrush(mBrush);
 
 	// Set default parameters
 	mFullScreen = isFullScreen();
 	mFullScreenPrev = mFullScreen;
+	mCanvasDabCount = 0;
+	mDabCount = 0;
+	mExportWidth = 8192;
+	mHistoryBudget = 64;
+	mHistoryBudgetPrev = mHistoryBudget;
+	mHistoryKilobytes = 0;
+	mRecordSession = true;
+	mReplayIndex = 0;
+	mReplaying = false;
+	mReplaySpeed = 4.0f;
+	mReplayStart = 0.0;
+	mReplayStroke = false;
 	mSize = 0.1f;
+	mSpacing = 0.25f;
 	mTransform = true;
+	mTransformPrev = mTransform;
+	mVerifyPrint = false;
 
 	// Create the parameters bar
-	mParams = params::InterfaceGl("Parameters", Vec2i(210, 200));
+	mParams = params::InterfaceGl("Parameters", Vec2i(210, 400));
 	mParams.addSeparator("");
 	mParams.addParam("Brush size", & mSize, "min=0.0000 max=1.0000 step=0.0001 keyDecr=a keyIncr=A");
+	mParams.addParam("Brush spacing", & mSpacing, "min=0.01 max=2.00 step=0.01 keyDecr=e keyIncr=E");
 	mParams.addParam("Brush transform", & mTransform, "key=b");
-	mParams.addButton("Clear", std::bind(& BrushApp::clearPoints, this), "key=c");
+	mParams.addButton("Clear", std::bind(& BrushApp::clearCanvas, this), "key=c");
+	mParams.addParam("Dab count", & mDabCount, "", true);
+	mParams.addSeparator("");
+	mParams.addButton("Undo", std::bind(& BrushApp::undo, this), "key=z");
+	mParams.addButton("Redo", std::bind(& BrushApp::redo, this), "key=y");
+	mParams.addParam("Undo budget (MB)", & mHistoryBudget, "min=1 max=1024 step=1 keyDecr=f keyIncr=F");
+	mParams.addParam("Undo memory (KB)", & mHistoryKilobytes, "", true);
+	mParams.addSeparator("");
+	mParams.addParam("Export width", & mExportWidth, "min=256 max=16384 step=256 keyDecr=g keyIncr=G");
+	mParams.addButton("Export print", std::bind(& BrushApp::exportPrint, this), "key=p");
+	mParams.addButton("Verify print", std::bind(& BrushApp::verifyPrint, this), "key=v");
+	mParams.addSeparator("");
+	mParams.addParam("Replay speed", & mReplaySpeed, "min=0 max=1000 step=1 keyDecr=h keyIncr=H");
+	mParams.addButton("Replay recording", std::bind(& BrushApp::startReplay, this), "key=r");
+	mParams.addParam("Replaying", & mReplaying, "", true);
 	mParams.addSeparator("");
 	mParams.addParam("Frame rate", & mFrameRate, "", true);
 	mParams.addParam("Full screen", & mFullScreen, "key=d");
@@ -261,7 +2283,15 @@ void BrushApp::shutdown()
 {
 
 	// Clean up
-	mPoints.clear();
+	mReader.close();
+	mRecorder.close();
+	mBrush = Surface8u();
+	mHistory.clear();
+	mStrokeDabs.clear();
+	mStrokeLog.clear();
+	mStrokeSamples.clear();
+	if (mCanvas)
+		mCanvas.reset();
 	if (mShader)
 		mShader.reset();
 	if (mShaderPassThru)
@@ -288,6 +2318,35 @@ void BrushApp::trace(const string & message)
 
 }
 
+// Saves the undo tiles under dabs before they're painted
+void BrushApp::touchDabs(size_t first, size_t last)
+{
+	float radius = (float)getWindowWidth() * 0.5f * 0.7071f / 65535.0f;
+	for (size_t i = first; i < last; i++)
+	{
+		const BrushDab & dab = mStrokeLog[i];
+		int32_t extent = mTransform ? (int32_t)((float)dab.mSize * radius) + 2 : 2;
+		mHistory.touch(mCanvas, Area(dab.mX - extent, dab.mY - extent, dab.mX + extent, dab.mY + extent));
+	}
+}
+
+// Undo the last stroke
+void BrushApp::undo()
+{
+
+	// Remove the stroke, repainting the whole canvas 
+	// if its saved tiles are out of date
+	bool replay = false;
+	if (mHistory.undo(mCanvas, mStrokeLog, replay))
+	{
+		if (replay)
+			initCanvas();
+		mCanvasDabCount = mStrokeLog.size();
+		record(StrokeRecord::TYPE_UNDO);
+	}
+
+}
+
 // Runs update logic
 void BrushApp::update()
 {
@@ -304,13 +2363,41 @@ void BrushApp::update()
 		mFullScreenPrev = mFullScreen;
 	}
 
-	// Toggle between transform and pass-thru shader
+	// Toggle between transform and pass-thru shader. The
+	// canvas is repainted with the new shader.
 	if (mTransform != mTransformPrev)
 	{
 		mShader = mTransform ? mShaderTransform : mShaderPassThru;
 		mTransformPrev = mTransform;
+		initCanvas();
+	}
+
+	// Play back the recording
+	if (mReplaying)
+		replay();
+
+	// Interpolate this frame's mouse samples
+	mStroke.update(mStrokeSamples, mStrokeDabs);
+	mStrokeSamples.clear();
+	addDabs();
+
+	// Update undo budget
+	if (mHistoryBudget != mHistoryBudgetPrev)
+	{
+		mHistory.setBudget((size_t)mHistoryBudget * 1024 * 1024);
+		mHistoryBudgetPrev = mHistoryBudget;
 	}
+	mHistoryKilobytes = (int32_t)(mHistory.getByteCount() / 1024);
 
+	// Write this frame's records
+	mRecorder.flush();
+
+}
+
+// Compares the print with the window on the next frame
+void BrushApp::verifyPrint()
+{
+	mVerifyPrint = true;
 }
 
 // Run application
@@ -6,5 +6,11 @@
 #define RES_SHADER_FRAG_150		CINDER_RESOURCE(../resources/, frag_150.glsl, 129, GLSL)
 #define RES_SHADER_GEOM_120		CINDER_RESOURCE(../resources/, geom_120.glsl, 130, GLSL)
 #define RES_SHADER_GEOM_150		CINDER_RESOURCE(../resources/, geom_150.glsl, 131, GLSL)
+#define RES_SHADER_INSTANCED_VERT_120	CINDER_RESOURCE(../resources/, instanced_vert_120.glsl, 134, GLSL)
+#define RES_SHADER_INSTANCED_VERT_150	CINDER_RESOURCE(../resources/, instanced_vert_150.glsl, 135, GLSL)
+#define RES_SHADER_RESOLVE_FRAG_120	CINDER_RESOURCE(../resources/, resolve_frag_120.glsl, 136, GLSL)
+#define RES_SHADER_RESOLVE_FRAG_150	CINDER_RESOURCE(../resources/, resolve_frag_150.glsl, 137, GLSL)
+#define RES_SHADER_RESOLVE_VERT_120	CINDER_RESOURCE(../resources/, resolve_vert_120.glsl, 138, GLSL)
+#define RES_SHADER_RESOLVE_VERT_150	CINDER_RESOURCE(../resources/, resolve_vert_150.glsl, 139, GLSL)
 #define RES_SHADER_VERT_120		CINDER_RESOURCE(../resources/, vert_120.glsl, 132, GLSL)
 #define RES_SHADER_VERT_150		CINDER_RESOURCE(../resources/, vert_150.glsl, 133, GLSL)
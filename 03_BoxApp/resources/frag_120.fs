@@ -4,18 +4,52 @@
 uniform float alpha;
 uniform vec3 eyePoint;
 uniform vec4 lightAmbient;
+uniform int lightCount;
+uniform sampler2D lightData;
 uniform vec4 lightDiffuse;
-uniform vec4 lightSpecular;
+uniform sampler2D lightGrid;
+uniform vec2 lightIndexSize;
+uniform sampler2D lightIndices;
 uniform vec3 lightPosition;
+uniform vec4 lightSpecular;
+uniform vec2 lightTiles;
+uniform float lightTileSize;
+uniform mat4 mvpInverse;
+uniform bool oit;
+uniform float oitDepth;
 uniform float shininess;
 uniform bool transform;
 uniform float uvmix;
 
 // Input attributes
+varying vec4 modelPositionOut;
 varying vec4 normalOut;
 varying vec4 positionOut;
 varying vec2 uvOut;
 
+// Returns the diffuse light from one clustered point light.
+// "index" is the light's place in the tile lists.
+vec3 addLight(float index, vec3 point, vec3 surfaceNormal)
+{
+
+	// The tile lists pack four light numbers into each texel
+	float texel = floor(index / 4.0);
+	vec4 lights = texture2D(lightIndices, (vec2(mod(texel, lightIndexSize.x), floor(texel / lightIndexSize.x)) + 0.5) / lightIndexSize);
+	float light = dot(lights, vec4(equal(vec4(mod(index, 4.0)), vec4(0.0, 1.0, 2.0, 3.0))));
+
+	// Light data is 256 texels wide. The first row holds 
+	// position and radius, the second holds color.
+	vec4 sphere = texture2D(lightData, vec2((light + 0.5) / 256.0, 0.25));
+	vec3 lightColor = texture2D(lightData, vec2((light + 0.5) / 256.0, 0.75)).rgb;
+
+	// Diffuse light, fading to zero at the radius
+	vec3 toLight = sphere.xyz - point;
+	float range = max(length(toLight), 0.0001);
+	float falloff = max(1.0 - range / sphere.w, 0.0);
+	return lightColor * max(dot(surfaceNormal, toLight / range), 0.0) * falloff * falloff;
+
+}
+
 // Kernel
 void main(void)
 {
@@ -42,6 +76,23 @@ void main(void)
 		// Set color from light
 		color = ambient + diffuse + specular;
 
+		// Add the clustered point lights. Lighting is done in 
+		// model space at the fragment's own position, so the 
+		// projection is undone on the normal. The fragment's 
+		// screen tile lists only the lights whose spheres 
+		// reach it.
+		if (lightCount > 0)
+		{
+			vec3 modelNormal = normalize((mvpInverse * normalOut).xyz);
+			vec2 tile = texture2D(lightGrid, (floor(gl_FragCoord.xy / lightTileSize) + 0.5) / lightTiles).xy;
+			for (int i = 0; i < 256; i++)
+			{
+				if (float(i) >= tile.y)
+					break;
+				color.rgb += addLight(tile.x + float(i), modelPositionOut.xyz, modelNormal);
+			}
+		}
+
 		// Mix with UV map
 		color = mix(color, vec4(uvOut.s, uvOut.t, 1.0, 1.0), uvmix);
 
@@ -57,7 +108,21 @@ void main(void)
 	
 	}
 
-	// Set final color
-	gl_FragColor = color;
+	// Set final color. When drawing order independent 
+	// transparency, weight color by depth so nearer surfaces 
+	// count for more, then premultiply. Alpha is left as is 
+	// so the blend keeps the product of (1 - alpha) in the 
+	// first target.
+	if (oit)
+	{
+		float w = clamp(0.03 / (0.00001 + pow((1.0 / gl_FragCoord.w) / oitDepth, 4.0)), 0.01, 3000.0);
+		gl_FragData[0] = vec4(color.rgb * color.a * w, color.a);
+		gl_FragData[1] = vec4(color.a * w);
+	}
+	else
+	{
+		gl_FragData[0] = color;
+		gl_FragData[1] = vec4(0.0, 0.0, 0.0, 0.0);
+	}
 
 }
@@ -4,9 +4,19 @@
 uniform float alpha;
 uniform vec3 eyePoint;
 uniform vec4 lightAmbient;
+uniform int lightCount;
+uniform sampler2D lightData;
 uniform vec4 lightDiffuse;
-uniform vec4 lightSpecular;
+uniform sampler2D lightGrid;
+uniform vec2 lightIndexSize;
+uniform sampler2D lightIndices;
 uniform vec3 lightPosition;
+uniform vec4 lightSpecular;
+uniform vec2 lightTiles;
+uniform float lightTileSize;
+uniform mat4 mvpInverse;
+uniform bool oit;
+uniform float oitDepth;
 uniform float shininess;
 uniform bool transform;
 uniform float uvmix;
@@ -16,8 +26,33 @@ in vec4 normal;
 in vec4 position;
 in vec2 uv;
 
-// Output attributes
+// Output attributes. Weight is only written to when 
+// drawing order independent transparency.
 out vec4 color;
+out vec4 weight;
+
+// Returns the diffuse light from one clustered point light.
+// "index" is the light's place in the tile lists.
+vec3 addLight(float index, vec3 point, vec3 surfaceNormal)
+{
+
+	// The tile lists pack four light numbers into each texel
+	float texel = floor(index / 4.0);
+	vec4 lights = texture(lightIndices, (vec2(mod(texel, lightIndexSize.x), floor(texel / lightIndexSize.x)) + 0.5) / lightIndexSize);
+	float light = dot(lights, vec4(equal(vec4(mod(index, 4.0)), vec4(0.0, 1.0, 2.0, 3.0))));
+
+	// Light data is 256 texels wide. The first row holds 
+	// position and radius, the second holds color.
+	vec4 sphere = texture(lightData, vec2((light + 0.5) / 256.0, 0.25));
+	vec3 lightColor = texture(lightData, vec2((light + 0.5) / 256.0, 0.75)).rgb;
+
+	// Diffuse light, fading to zero at the radius
+	vec3 toLight = sphere.xyz - point;
+	float range = max(length(toLight), 0.0001);
+	float falloff = max(1.0 - range / sphere.w, 0.0);
+	return lightColor * max(dot(surfaceNormal, toLight / range), 0.0) * falloff * falloff;
+
+}
 
 // Kernel
 void main(void)
@@ -45,6 +80,23 @@ void main(void)
 		// Set color from light
 		color = ambient + diffuse + specular;
 
+		// Add the clustered point lights. Lighting is done in 
+		// model space, so the projection is undone on the 
+		// position and normal. The fragment's screen tile lists
+		// only the lights whose spheres reach it.
+		if (lightCount > 0)
+		{
+			vec4 modelPosition = mvpInverse * position;
+			vec3 modelNormal = normalize((mvpInverse * normal).xyz);
+			vec2 tile = texture(lightGrid, (floor(gl_FragCoord.xy / lightTileSize) + 0.5) / lightTiles).xy;
+			for (int i = 0; i < 256; i++)
+			{
+				if (float(i) >= tile.y)
+					break;
+				color.rgb += addLight(tile.x + float(i), modelPosition.xyz / modelPosition.w, modelNormal);
+			}
+		}
+
 		// Mix with UV map
 		color = mix(color, vec4(uv.s, uv.t, 1.0, 1.0), uvmix);
 
@@ -60,4 +112,15 @@ void main(void)
 	
 	}
 
+	// Weight color by depth so nearer surfaces count for more, 
+	// then premultiply. Alpha is left as is so the blend keeps 
+	// the product of (1 - alpha) in the first target.
+	weight = vec4(0.0, 0.0, 0.0, 0.0);
+	if (oit)
+	{
+		float w = clamp(0.03 / (0.00001 + pow((1.0 / gl_FragCoord.w) / oitDepth, 4.0)), 0.01, 3000.0);
+		weight = vec4(color.a * w);
+		color = vec4(color.rgb * color.a * w, color.a);
+	}
+
 }
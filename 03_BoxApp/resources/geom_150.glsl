@@ -2,6 +2,11 @@
 
 // Uniforms
 uniform vec4 dimensions;
+uniform vec3 eyeModel;
+uniform bool lod;
+uniform int lodLevel;
+uniform vec2 lodRange;
+uniform float lodScale;
 uniform mat4 mvp;
 uniform float rotation;
 uniform bool transform;
@@ -29,6 +34,48 @@ void addVertex(vec2 texCoord, vec4 vert, vec4 norm)
 
 }
 
+// Builds the rotation for a box from its angle. This 
+// also scales and shears the box.
+mat4 boxRotation(float angle)
+{
+
+	// Define rotation matrix
+	mat4 rotMatrix;
+	rotMatrix[0].x = 1.0 + cos(angle);
+	rotMatrix[0].y = 1.0 + -sin(angle);
+	rotMatrix[0].z = 1.0 + -rotMatrix[0].x;
+	rotMatrix[0].w = 0.0;
+	rotMatrix[1].x = 1.0 + -rotMatrix[0].z;
+	rotMatrix[1].y = 1.0 + -rotMatrix[0].y;
+	rotMatrix[1].z = 1.0 + -rotMatrix[0].x;
+	rotMatrix[1].w = 0.0;
+	rotMatrix[2].x = 0.0;
+	rotMatrix[2].y = 0.0;
+	rotMatrix[2].z = 1.0;
+	rotMatrix[2].w = 0.0;
+	rotMatrix[3].x = 0.0;
+	rotMatrix[3].y = 0.0;
+	rotMatrix[3].z = 0.0;
+	rotMatrix[3].w = 1.0;
+	return rotMatrix;
+
+}
+
+// Radius of the sphere around a box's corners. The rotation
+// matrix scales the box, so the radius is measured to the 
+// farthest corner after it's applied.
+float boxRadius(mat4 rotMatrix)
+{
+	vec3 axisX = (vec4(dimensions.x, 0.0, 0.0, 0.0) * rotMatrix).xyz;
+	vec3 axisY = (vec4(0.0, dimensions.y, 0.0, 0.0) * rotMatrix).xyz;
+	vec3 axisZ = (vec4(0.0, 0.0, dimensions.z, 0.0) * rotMatrix).xyz;
+	float radius = length(axisX + axisY + axisZ);
+	radius = max(radius, length(axisX + axisY - axisZ));
+	radius = max(radius, length(axisX - axisY + axisZ));
+	radius = max(radius, length(axisX - axisY - axisZ));
+	return radius;
+}
+
 // Kernel
 void main(void)
 {
@@ -36,32 +83,55 @@ void main(void)
 	// Passes original vertex position to fragment shader
 	position = mvp * vertex[0];
 
+	// Boxes are rotated by their Y position
+	mat4 rotMatrix = boxRotation(vertex[0].y * rotation);
+
+	// With level of detail on, pick a level from the box's 
+	// size on screen. Big boxes are built in full, mid-sized 
+	// boxes become a quad facing the eye, and small boxes 
+	// become points. Each level is drawn in its own pass, so
+	// boxes in other levels are skipped. Points are drawn by
+	// the pass-thru program, which outputs points.
+	if (transform && lod)
+	{
+
+		// Diameter of the box's bounding sphere in pixels
+		float radius = boxRadius(rotMatrix);
+		float size = 2.0 * radius * lodScale / position.w;
+		int level = size < lodRange.y ? 2 : (size < lodRange.x ? 1 : 0);
+		if (level != lodLevel)
+			return;
+		vec3 forward = normalize(eyeModel - vertex[0].xyz);
+
+		// Point
+		if (level == 2)
+		{
+			addVertex(vec2(0.5, 0.5), position, mvp * vec4(forward, 0.0));
+			EndPrimitive();
+			return;
+		}
+
+		// Billboard. The quad is as wide as the bounding sphere 
+		// and its normal points at the eye.
+		if (level == 1)
+		{
+			vec3 right = normalize(cross(forward, abs(forward.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0))) * radius;
+			vec3 up = normalize(cross(right, forward)) * radius;
+			vec4 norm = mvp * vec4(forward, 0.0);
+			addVertex(vec2(0.0, 0.0), mvp * (vertex[0] - vec4(right + up, 0.0)), norm);
+			addVertex(vec2(1.0, 0.0), mvp * (vertex[0] + vec4(right - up, 0.0)), norm);
+			addVertex(vec2(0.0, 1.0), mvp * (vertex[0] - vec4(right - up, 0.0)), norm);
+			addVertex(vec2(1.0, 1.0), mvp * (vertex[0] + vec4(right + up, 0.0)), norm);
+			EndPrimitive();
+			return;
+		}
+
+	}
+
 	// Transform point to box
 	if (transform)
 	{
 
-		// Use Y position for phase
-		float angle = vertex[0].y * rotation;
-	
-		// Define rotation matrix
-		mat4 rotMatrix;
-		rotMatrix[0].x = 1.0 + cos(angle);
-		rotMatrix[0].y = 1.0 + -sin(angle);
-		rotMatrix[0].z = 1.0 + -rotMatrix[0].x;
-		rotMatrix[0].w = 0.0;
-		rotMatrix[1].x = 1.0 + -rotMatrix[0].z;
-		rotMatrix[1].y = 1.0 + -rotMatrix[0].y;
-		rotMatrix[1].z = 1.0 + -rotMatrix[0].x;
-		rotMatrix[1].w = 0.0;
-		rotMatrix[2].x = 0.0;
-		rotMatrix[2].y = 0.0;
-		rotMatrix[2].z = 1.0;
-		rotMatrix[2].w = 0.0;
-		rotMatrix[3].x = 0.0;
-		rotMatrix[3].y = 0.0;
-		rotMatrix[3].z = 0.0;
-		rotMatrix[3].w = 1.0;
-
 		// Define vertices
 		vec4 vert0 = mvp * (vertex[0] + vec4(dimensions * vec4(-1.0, -1.0, -1.0, 0.0)) * rotMatrix); // 0 ---
 		vec4 vert1 = mvp * (vertex[0] + vec4(dimensions * vec4( 1.0, -1.0, -1.0, 0.0)) * rotMatrix); // 1 +--
@@ -86,47 +156,83 @@ void main(void)
 		vec2 uv2 = vec2(1.0, 1.0); // ++
 		vec2 uv3 = vec2(0.0, 1.0); // -+
 
+		// Find the box's axes in model space. Its center is the 
+		// point, and each face is one axis away from it.
+		vec3 axisX = (vec4(dimensions * vec4(1.0, 0.0, 0.0, 0.0)) * rotMatrix).xyz;
+		vec3 axisY = (vec4(dimensions * vec4(0.0, 1.0, 0.0, 0.0)) * rotMatrix).xyz;
+		vec3 axisZ = (vec4(dimensions * vec4(0.0, 0.0, 1.0, 0.0)) * rotMatrix).xyz;
+
+		// Outward face normals. The rotation matrix can mirror 
+		// the box, so we flip the normals when it does.
+		float handedness = sign(dot(cross(axisY, axisZ), axisX));
+		vec3 normalX = cross(axisY, axisZ) * handedness;
+		vec3 normalY = cross(axisZ, axisX) * handedness;
+		vec3 normalZ = cross(axisX, axisY) * handedness;
+
+		// A face is visible when the eye is on the outside of its 
+		// plane. No more than three faces pass, so we emit at most 
+		// 12 vertices instead of 24.
+		vec3 eye = eyeModel - vertex[0].xyz;
+
 		// Left
-		addVertex(uv1, vert5, norm3);
-		addVertex(uv2, vert7, norm3);
-		addVertex(uv0, vert4, norm3);
-		addVertex(uv3, vert6, norm3);
-		EndPrimitive();
+		if (dot(normalZ, eye - axisZ) > 0.0)
+		{
+			addVertex(uv1, vert5, norm3);
+			addVertex(uv2, vert7, norm3);
+			addVertex(uv0, vert4, norm3);
+			addVertex(uv3, vert6, norm3);
+			EndPrimitive();
+		}
 
 		// Right
-		addVertex(uv3, vert3, norm0);
-		addVertex(uv0, vert1, norm0);
-		addVertex(uv2, vert2, norm0);
-		addVertex(uv1, vert0, norm0);
-		EndPrimitive();
+		if (dot(normalZ, eye + axisZ) < 0.0)
+		{
+			addVertex(uv3, vert3, norm0);
+			addVertex(uv0, vert1, norm0);
+			addVertex(uv2, vert2, norm0);
+			addVertex(uv1, vert0, norm0);
+			EndPrimitive();
+		}
 
 		// Top
-		addVertex(uv1, vert7, norm1);
-		addVertex(uv2, vert3, norm1);
-		addVertex(uv0, vert6, norm1);
-		addVertex(uv3, vert2, norm1);
-		EndPrimitive();
+		if (dot(normalY, eye - axisY) > 0.0)
+		{
+			addVertex(uv1, vert7, norm1);
+			addVertex(uv2, vert3, norm1);
+			addVertex(uv0, vert6, norm1);
+			addVertex(uv3, vert2, norm1);
+			EndPrimitive();
+		}
 
 		// Bottom
-		addVertex(uv1, vert1, norm4);
-		addVertex(uv2, vert5, norm4);
-		addVertex(uv0, vert0, norm4);
-		addVertex(uv3, vert4, norm4);
-		EndPrimitive();
+		if (dot(normalY, eye + axisY) < 0.0)
+		{
+			addVertex(uv1, vert1, norm4);
+			addVertex(uv2, vert5, norm4);
+			addVertex(uv0, vert0, norm4);
+			addVertex(uv3, vert4, norm4);
+			EndPrimitive();
+		}
 
 		// Front
-		addVertex(uv2, vert3, norm2);
-		addVertex(uv3, vert7, norm2);
-		addVertex(uv1, vert1, norm2);
-		addVertex(uv0, vert5, norm2);
-		EndPrimitive();
+		if (dot(normalX, eye - axisX) > 0.0)
+		{
+			addVertex(uv2, vert3, norm2);
+			addVertex(uv3, vert7, norm2);
+			addVertex(uv1, vert1, norm2);
+			addVertex(uv0, vert5, norm2);
+			EndPrimitive();
+		}
 
 		// Back
-		addVertex(uv2, vert6, norm5);
-		addVertex(uv1, vert2, norm5);
-		addVertex(uv3, vert4, norm5);
-		addVertex(uv0, vert0, norm5);
-		EndPrimitive();
+		if (dot(normalX, eye + axisX) < 0.0)
+		{
+			addVertex(uv2, vert6, norm5);
+			addVertex(uv1, vert2, norm5);
+			addVertex(uv3, vert4, norm5);
+			addVertex(uv0, vert0, norm5);
+			EndPrimitive();
+		}
 
 	}
 	else
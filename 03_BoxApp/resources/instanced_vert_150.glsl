@@ -0,0 +1,68 @@
+#version 150
+
+// Uniforms
+uniform float amp;
+uniform vec4 dimensions;
+uniform ivec2 grid;
+uniform mat4 mvp;
+uniform float phase;
+uniform float rotation;
+uniform float scale;
+uniform float speed;
+uniform float width;
+
+// Input attributes
+in vec3 cornerIn;
+in vec3 normalIn;
+in vec2 uvIn;
+
+// Output attributes
+out vec4 normal;
+out vec4 position;
+out vec2 uv;
+
+// Kernel
+void main(void)
+{
+
+	// Each instance is one box. Its position in the grid 
+	// comes from the instance index, numbered left to right, 
+	// top to bottom.
+	vec4 vertex = vec4(float(gl_InstanceID % grid.x) - float(grid.x) * 0.5, float(gl_InstanceID / grid.x) - float(grid.y) * 0.5, 0.0, 1.0);
+
+	// Use time to reposition the box
+	float wave = (sin((phase * speed) + vertex.x * width)) * (amp * scale);
+	vertex = vec4(scale * vertex.x, scale * vertex.y + wave, scale * vertex.z - wave, 1.0);
+
+	// Use Y position for phase
+	float angle = vertex.y * rotation;
+
+	// Define rotation matrix
+	mat4 rotMatrix;
+	rotMatrix[0].x = 1.0 + cos(angle);
+	rotMatrix[0].y = 1.0 + -sin(angle);
+	rotMatrix[0].z = 1.0 + -rotMatrix[0].x;
+	rotMatrix[0].w = 0.0;
+	rotMatrix[1].x = 1.0 + -rotMatrix[0].z;
+	rotMatrix[1].y = 1.0 + -rotMatrix[0].y;
+	rotMatrix[1].z = 1.0 + -rotMatrix[0].x;
+	rotMatrix[1].w = 0.0;
+	rotMatrix[2].x = 0.0;
+	rotMatrix[2].y = 0.0;
+	rotMatrix[2].z = 1.0;
+	rotMatrix[2].w = 0.0;
+	rotMatrix[3].x = 0.0;
+	rotMatrix[3].y = 0.0;
+	rotMatrix[3].z = 0.0;
+	rotMatrix[3].w = 1.0;
+
+	// Move this corner of the shared cube into place. This is 
+	// the same math the geometry shader runs for each corner.
+	gl_Position = mvp * (vertex + vec4(dimensions * vec4(cornerIn, 0.0)) * rotMatrix);
+
+	// Pass normal, position, and UV to fragment shader
+	normal = mvp * vec4(normalIn, 0.0);
+	position = gl_Position;
+	uv = uvIn;
+
+}
@@ -1,9 +1,12 @@
 #version 120
+#extension GL_EXT_gpu_shader4 : enable
 
 // Uniforms
 uniform float amp;
+uniform ivec2 grid;
 uniform mat4 mvp;
 uniform float phase;
+uniform bool procedural;
 uniform float scale;
 uniform float speed;
 uniform float width;
@@ -15,8 +18,13 @@ varying vec4 vertex;
 void main(void)
 {
 
-	// Get vertex position
-	vertex = gl_Vertex;
+	// Get vertex position. In procedural mode, there is no vertex
+	// buffer. The position comes from the vertex's index in the 
+	// grid, numbered left to right, top to bottom.
+	if (procedural)
+		vertex = vec4(float(gl_VertexID % grid.x) - float(grid.x) * 0.5, float(gl_VertexID / grid.x) - float(grid.y) * 0.5, 0.0, 1.0);
+	else
+		vertex = gl_Vertex;
 
 	// Use time to reposition output vertex
 	float wave = (sin((phase * speed) + vertex.x * width)) * (amp * scale);
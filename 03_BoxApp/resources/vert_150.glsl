@@ -2,8 +2,10 @@
 
 // Uniforms
 uniform float amp;
+uniform ivec2 grid;
 uniform mat4 mvp;
 uniform float phase;
+uniform bool procedural;
 uniform float scale;
 uniform float speed;
 uniform float width;
@@ -18,8 +20,13 @@ out vec4 vertex;
 void main(void)
 {
 
-	// Get vertex position
-	vertex = vertexIn;
+	// Get vertex position. In procedural mode, there is no vertex
+	// buffer. The position comes from the vertex's index in the 
+	// grid, numbered left to right, top to bottom.
+	if (procedural)
+		vertex = vec4(float(gl_VertexID % grid.x) - float(grid.x) * 0.5, float(gl_VertexID / grid.x) - float(grid.y) * 0.5, 0.0, 1.0);
+	else
+		vertex = vertexIn;
 
 	// Use time to reposition output vertex
 	float wave = (sin((phase * speed) + vertex.x * width)) * (amp * scale);
@@ -2,12 +2,17 @@
 #include <cinder/app/AppBasic.h>
 #include <cinder/Arcball.h>
 #include <cinder/Camera.h>
+#include <cinder/gl/Fbo.h>
 #include <cinder/gl/GlslProg.h>
 #include <cinder/gl/Vbo.h>
 #include <cinder/ImageIo.h>
 #include <cinder/params/Params.h>
+#include <cinder/Rand.h>
+#include <cinder/Thread.h>
+#include <cinder/Timer.h>
 #include <cinder/Utilities.h>
 #include <Resources.h>
+#include <WaveField.h>
 
 /*
  * This application demonstrates how to create a vertex
@@ -60,13 +65,70 @@ private:
 	int32_t mMeshWidth;
 	int32_t mMeshWidthPrev;
 
+	// Procedural mode builds grid positions in the shader, so
+	// resizing the mesh never rebuilds the VBO. Attribute 0 
+	// must still be an enabled array, so it points at a 
+	// buffer of zeros that only grows with the grid.
+	void drawGrid();
+	bool mMeshProcedural;
+	bool mMeshProceduralPrev;
+	size_t mProceduralVertexCount;
+	ci::gl::Vbo mProceduralVertices;
+
 	// Box
 	ci::Vec3f mBoxDimensions;
 	bool mBoxEnabled;
 	bool mBoxEnabledPrev;
 	float mBoxRotationSpeed;
 
+	// Instanced boxes. Instead of building each box in the
+	// geometry shader, a shared cube is drawn once per grid 
+	// point and the vertex shader moves it into place.
+	void initCube();
+	ci::gl::Vbo mCubeIndices;
+	ci::gl::Vbo mCubeVertices;
+	bool mBoxInstanced;
+	ci::gl::GlslProg mShaderInstanced;
+
+	// Level of detail. The geometry shader draws each box in 
+	// full, as a quad facing the eye, or as a point, depending 
+	// on its size on screen. Sizes are in pixels. Each level is
+	// drawn in its own pass, and a primitives query counts what
+	// the billboard and point passes draw. Queries are only read
+	// once their results are available, so the CPU never waits.
+	static const int32_t LOD_QUERY_FRAMES = 3;
+	float getLodScale();
+	void readLevels();
+	float mLodBillboardSize;
+	int32_t mLodBillboardCount;
+	int32_t mLodBoxCount;
+	bool mLodEnabled;
+	float mLodPointSize;
+	int32_t mLodPointCount;
+	int32_t mLodQueryFrame;
+	int32_t mLodQueryGrid[LOD_QUERY_FRAMES];
+	bool mLodQueryPending[LOD_QUERY_FRAMES];
+	GLuint mLodQueries[LOD_QUERY_FRAMES][2];
+
+	// Weighted blended transparency. Every box is drawn once 
+	// into a color target and a weight target, then the targets
+	// are resolved onto the screen. Nothing is sorted, and the
+	// result doesn't depend on draw order.
+	void drawMeshTransparent();
+	GLenum mOitAttachments[2];
+	bool mOitEnabled;
+	ci::gl::Fbo mOitFbo;
+	ci::gl::Fbo::Format mOitFormat;
+	ci::gl::GlslProg mShaderResolve;
+
+	// Benchmark
+	static const int32_t BENCHMARK_FRAMES = 10;
+	void runBenchmark();
+	void runWaveBenchmark();
+
 	// Shader
+	void bindFragData(ci::gl::GlslProg & shader);
+	void bindShader(ci::gl::GlslProg & shader, bool transparent, bool lod);
 	void loadShader();
 	double mGlslVersion;
 	ci::gl::GlslProg mShader;
@@ -79,9 +141,37 @@ private:
 	ci::Vec3f mLightPosition;
 	float mLightShininess;
 	ci::ColorAf mLightSpecular;
+
+	// Clustered lights. Point lights drift over the grid. Each
+	// frame, the CPU bins them into screen tiles and uploads the
+	// lists as textures, so a fragment only evaluates the lights 
+	// that reach its tile. Turning culling off puts every light
+	// in every tile. Radius is in grid cells.
+	static const int32_t LIGHT_INDEX_WIDTH = 1024;
+	static const int32_t LIGHT_MAX = 256;
+	static const int32_t LIGHT_TILE_SIZE = 32;
+	void binLights(const ci::Matrix44f & mvp, float pixelScale);
+	void runLightBenchmark();
+	std::vector<ci::Colorf> mLightColors;
+	int32_t mLightCount;
+	bool mLightCulling;
+	ci::Surface32f mLightData;
+	ci::gl::Texture mLightDataTexture;
+	ci::Surface32f mLightGrid;
+	ci::gl::Texture mLightGridTexture;
+	ci::Surface32f mLightIndices;
+	ci::gl::Texture mLightIndexTexture;
+	std::vector<ci::Vec4f> mLightOrigins;
+	float mLightRadius;
+	std::vector<ci::Area> mLightRects;
+	std::vector<int32_t> mLightTileCursors;
+	float mLightsPerTile;
+	ci::gl::Texture::Format mLightTextureFormat;
 	
 	// VBO
+	void drawMesh(bool transparent);
 	void initMesh();
+	bool mVboDirty;
 	std::vector<uint32_t> mVboIndices;
 	ci::gl::VboMesh::Layout mVboLayout;
 	std::vector<ci::Vec3f> mVboVertices;
@@ -107,6 +197,168 @@ using namespace ci;
 using namespace ci::app;
 using namespace std;
 
+// GLSL 1.5 shaders write to a second output when drawing
+// transparency. Outputs must be numbered before the program
+// is linked, so we number them and link again.
+void BoxApp::bindFragData(gl::GlslProg & shader)
+{
+	glBindFragDataLocationEXT(shader.getHandle(), 0, "color");
+	glBindFragDataLocationEXT(shader.getHandle(), 1, "weight");
+	glLinkProgram(shader.getHandle());
+}
+
+// Moves the clustered lights, then bins them into screen 
+// tiles and uploads the results
+void BoxApp::binLights(const Matrix44f & mvp, float pixelScale)
+{
+
+	// Size the tile grid to the window
+	int32_t tilesX = (getWindowWidth() + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	int32_t tilesY = (getWindowHeight() + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	if (!mLightGrid || mLightGrid.getWidth() != tilesX || mLightGrid.getHeight() != tilesY)
+	{
+		mLightGrid = Surface32f(tilesX, tilesY, true, SurfaceChannelOrder::RGBA);
+		mLightGridTexture = gl::Texture(mLightGrid, mLightTextureFormat);
+	}
+
+	// Lights circle their origins. Origins are stored as a 
+	// fraction of the grid, so they follow its size.
+	Vec3f extent = Vec3f((float)mMeshWidth, (float)mMeshHeight, mMeshWaveAmplitude * 4.0f) * mMeshScale;
+	float radius = mLightRadius * mMeshScale;
+	Vec2f window((float)getWindowWidth(), (float)getWindowHeight());
+	float * data = mLightData.getData();
+	int32_t dataStride = mLightData.getRowBytes() / sizeof(float);
+	mLightRects.resize(mLightCount);
+	for (int32_t i = 0; i < mLightCount; i++)
+	{
+
+		// Write position and radius to the first row, 
+		// and color to the second
+		float angle = mElapsedSeconds * 0.5f + mLightOrigins[i].w;
+		Vec3f position = mLightOrigins[i].xyz() * extent + Vec3f(math<float>::cos(angle), math<float>::sin(angle), 0.0f) * radius * 0.5f;
+		data[i * 4 + 0] = position.x;
+		data[i * 4 + 1] = position.y;
+		data[i * 4 + 2] = position.z;
+		data[i * 4 + 3] = radius;
+		data[dataStride + i * 4 + 0] = mLightColors[i].r;
+		data[dataStride + i * 4 + 1] = mLightColors[i].g;
+		data[dataStride + i * 4 + 2] = mLightColors[i].b;
+		data[dataStride + i * 4 + 3] = 1.0f;
+
+		// Find the tiles the light's sphere covers on screen. The 
+		// screen radius is measured from the sphere's nearest 
+		// point so the bounds stay conservative. Lights that 
+		// reach behind the eye cover every tile.
+		Vec4f clip = mvp * Vec4f(position, 1.0f);
+		if (!mLightCulling || clip.w <= radius)
+		{
+			mLightRects[i] = Area(0, 0, tilesX, tilesY);
+		}
+		else
+		{
+			Vec2f center = (Vec2f(clip.x, clip.y) / clip.w * 0.5f + Vec2f(0.5f, 0.5f)) * window;
+			float reach = radius * pixelScale / (clip.w - radius);
+			mLightRects[i] = Area(
+				math<int32_t>::clamp((int32_t)math<float>::floor((center.x - reach) / (float)LIGHT_TILE_SIZE), 0, tilesX), 
+				math<int32_t>::clamp((int32_t)math<float>::floor((center.y - reach) / (float)LIGHT_TILE_SIZE), 0, tilesY), 
+				math<int32_t>::clamp((int32_t)math<float>::floor((center.x + reach) / (float)LIGHT_TILE_SIZE) + 1, 0, tilesX), 
+				math<int32_t>::clamp((int32_t)math<float>::floor((center.y + reach) / (float)LIGHT_TILE_SIZE) + 1, 0, tilesY)
+				);
+		}
+
+	}
+
+	// Count the lights in each tile
+	int32_t tileCount = tilesX * tilesY;
+	mLightTileCursors.assign(tileCount, 0);
+	for (vector<Area>::const_iterator rectIt = mLightRects.begin(); rectIt != mLightRects.end(); ++rectIt)
+		for (int32_t y = rectIt->y1; y < rectIt->y2; y++)
+			for (int32_t x = rectIt->x1; x < rectIt->x2; x++)
+				mLightTileCursors[y * tilesX + x]++;
+
+	// Turn the counts into offsets. Each tile stores where its
+	// list starts and how long it is.
+	float * grid = mLightGrid.getData();
+	int32_t gridStride = mLightGrid.getRowBytes() / sizeof(float);
+	int32_t total = 0;
+	for (int32_t y = 0; y < tilesY; y++)
+		for (int32_t x = 0; x < tilesX; x++)
+		{
+			int32_t & cursor = mLightTileCursors[y * tilesX + x];
+			grid[y * gridStride + x * 4 + 0] = (float)total;
+			grid[y * gridStride + x * 4 + 1] = (float)cursor;
+			int32_t count = cursor;
+			cursor = total;
+			total += count;
+		}
+
+	// Grow the index list if it's too small. Four light 
+	// numbers are packed into each texel.
+	int32_t rows = math<int32_t>::max((total + LIGHT_INDEX_WIDTH * 4 - 1) / (LIGHT_INDEX_WIDTH * 4), 1);
+	if (!mLightIndices || mLightIndices.getHeight() < rows)
+	{
+		mLightIndices = Surface32f(LIGHT_INDEX_WIDTH, rows, true, SurfaceChannelOrder::RGBA);
+		mLightIndexTexture = gl::Texture(mLightIndices, mLightTextureFormat);
+	}
+
+	// Fill the lists
+	float * indices = mLightIndices.getData();
+	for (int32_t i = 0; i < mLightCount; i++)
+		for (int32_t y = mLightRects[i].y1; y < mLightRects[i].y2; y++)
+			for (int32_t x = mLightRects[i].x1; x < mLightRects[i].x2; x++)
+				indices[mLightTileCursors[y * tilesX + x]++] = (float)i;
+
+	// Upload
+	mLightDataTexture.update(mLightData);
+	mLightGridTexture.update(mLightGrid);
+	mLightIndexTexture.update(mLightIndices);
+	mLightsPerTile = (float)total / (float)tileCount;
+
+}
+
+// Binds a shader and sets its uniforms for the current 
+// model view
+void BoxApp::bindShader(gl::GlslProg & shader, bool transparent, bool lod)
+{
+
+	// Bind and configure shader
+	shader.bind();
+	shader.uniform("alpha", mMeshAlpha);
+	shader.uniform("amp", mMeshWaveAmplitude);
+	shader.uniform("eyePoint", mEyePoint);
+	shader.uniform("eyeModel", gl::getModelView().inverted().transformPoint(Vec3f::zero()));
+	shader.uniform("grid", Vec2i(mMeshWidth, mMeshHeight));
+	shader.uniform("lightAmbient", mLightAmbient);
+	shader.uniform("lightCount", mLightCount);
+	shader.uniform("lightData", 0);
+	shader.uniform("lightDiffuse", mLightDiffuse);
+	shader.uniform("lightGrid", 1);
+	shader.uniform("lightIndexSize", Vec2f((float)LIGHT_INDEX_WIDTH, mLightIndices ? (float)mLightIndices.getHeight() : 1.0f));
+	shader.uniform("lightIndices", 2);
+	shader.uniform("lightPosition", mLightPosition);
+	shader.uniform("lightSpecular", mLightSpecular);
+	shader.uniform("lightTiles", mLightGrid ? Vec2f((float)mLightGrid.getWidth(), (float)mLightGrid.getHeight()) : Vec2f::one());
+	shader.uniform("lightTileSize", (float)LIGHT_TILE_SIZE);
+	shader.uniform("lod", lod);
+	shader.uniform("lodLevel", 0);
+	shader.uniform("lodRange", Vec2f(mLodBillboardSize, mLodPointSize));
+	shader.uniform("lodScale", getLodScale());
+	shader.uniform("mvp", gl::getProjection() * gl::getModelView());
+	shader.uniform("mvpInverse", (gl::getProjection() * gl::getModelView()).inverted());
+	shader.uniform("oit", transparent);
+	shader.uniform("oitDepth", math<float>::max(mEyePoint.distance(mMeshOffset), 1.0f));
+	shader.uniform("phase", mElapsedSeconds);
+	shader.uniform("rotation", mBoxRotationSpeed);
+	shader.uniform("scale", mMeshScale);
+	shader.uniform("dimensions", Vec4f(mBoxDimensions));
+	shader.uniform("shininess", mLightShininess);
+	shader.uniform("speed", mMeshWaveSpeed);
+	shader.uniform("transform", mBoxEnabled);
+	shader.uniform("uvmix", mMeshUvMix);
+	shader.uniform("width", mMeshWaveWidth);
+
+}
+
 // Renders the scene
 void BoxApp::draw()
 {
@@ -116,40 +368,309 @@ void BoxApp::draw()
 	gl::setViewport(getWindowBounds());
 	gl::setMatrices(mCamera);
 	
+	// Draw the mesh
+	if (mOitEnabled && mOitFbo && mShaderResolve)
+		drawMeshTransparent();
+	else
+		drawMesh(false);
+
+	// Draw the params interface
+	params::InterfaceGl::draw();
+
+}
+
+// Draws one point per grid cell with the bound shader
+void BoxApp::drawGrid()
+{
+
+	// Draw the VBO
+	if (!mMeshProcedural)
+	{
+		gl::draw(mVboMesh);
+		return;
+	}
+
+	// The shader builds each point from gl_VertexID. Drivers 
+	// may skip draws with attribute 0 disabled, so it gets an 
+	// array the shader never reads. The buffer's contents don't 
+	// matter, so nothing is uploaded, and it doubles in size
+	// when the grid outgrows it.
+	size_t count = (size_t)mMeshWidth * (size_t)mMeshHeight;
+	if (!mProceduralVertices || mProceduralVertexCount < count)
+	{
+		size_t capacity = math<size_t>::max(mProceduralVertexCount, 4096);
+		while (capacity < count)
+			capacity *= 2;
+		if (!mProceduralVertices)
+			mProceduralVertices = gl::Vbo(GL_ARRAY_BUFFER);
+		mProceduralVertices.bufferData(capacity * sizeof(float), 0, GL_STATIC_DRAW);
+		mProceduralVertexCount = capacity;
+	}
+	mProceduralVertices.bind();
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)0);
+	glDrawArrays(GL_POINTS, 0, (GLsizei)count);
+	glDisableVertexAttribArray(0);
+	mProceduralVertices.unbind();
+
+}
+
+// Draws the mesh with the current shader or backend
+void BoxApp::drawMesh(bool transparent)
+{
+
 	// Move into position
 	gl::pushModelView();
 	gl::translate(mMeshOffset);
 	gl::rotate(mMeshRotation);
 
-	// Bind and configure shader
-	mShader.bind();
-	mShader.uniform("alpha", mMeshAlpha);
-	mShader.uniform("amp", mMeshWaveAmplitude);
-	mShader.uniform("eyePoint", mEyePoint);
-	mShader.uniform("lightAmbient", mLightAmbient);
-	mShader.uniform("lightDiffuse", mLightDiffuse);
-	mShader.uniform("lightPosition", mLightPosition);
-	mShader.uniform("lightSpecular", mLightSpecular);
-	mShader.uniform("mvp", gl::getProjection() * gl::getModelView());
-	mShader.uniform("phase", mElapsedSeconds);
-	mShader.uniform("rotation", mBoxRotationSpeed);
-	mShader.uniform("scale", mMeshScale);
-	mShader.uniform("dimensions", Vec4f(mBoxDimensions));
-	mShader.uniform("shininess", mLightShininess);
-	mShader.uniform("speed", mMeshWaveSpeed);
-	mShader.uniform("transform", mBoxEnabled);
-	mShader.uniform("uvmix", mMeshUvMix);
-	mShader.uniform("width", mMeshWaveWidth);
+	// Instanced boxes replace the geometry shader boxes. Points 
+	// are still drawn through the pass-thru shader.
+	bool instanced = mBoxEnabled && mBoxInstanced && mShaderInstanced;
+	gl::GlslProg & shader = instanced ? mShaderInstanced : mShader;
+
+	// Bin the clustered lights for this view
+	if (mLightCount > 0)
+	{
+		binLights(gl::getProjection() * gl::getModelView(), getLodScale());
+		mLightDataTexture.bind(0);
+		mLightGridTexture.bind(1);
+		mLightIndexTexture.bind(2);
+	}
+
+	// Bind and configure shader. Level of detail only 
+	// applies to the geometry shader boxes.
+	bool lod = mLodEnabled && mBoxEnabled && !instanced;
+	bindShader(shader, transparent, lod);
 	
-	// Draw VBO
-	gl::draw(mVboMesh);
+	// Draw one cube per grid point
+	if (instanced)
+	{
+
+		// Point the shader's attributes at the cube
+		GLint cornerLocation = shader.getAttribLocation("cornerIn");
+		GLint normalLocation = shader.getAttribLocation("normalIn");
+		GLint uvLocation = shader.getAttribLocation("uvIn");
+		GLsizei stride = 8 * sizeof(float);
+		mCubeVertices.bind();
+		if (cornerLocation >= 0)
+		{
+			glEnableVertexAttribArray(cornerLocation);
+			glVertexAttribPointer(cornerLocation, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)0);
+		}
+		if (normalLocation >= 0)
+		{
+			glEnableVertexAttribArray(normalLocation);
+			glVertexAttribPointer(normalLocation, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)(3 * sizeof(float)));
+		}
+		if (uvLocation >= 0)
+		{
+			glEnableVertexAttribArray(uvLocation);
+			glVertexAttribPointer(uvLocation, 2, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)(6 * sizeof(float)));
+		}
+
+		// Draw
+		mCubeIndices.bind();
+		glDrawElementsInstancedARB(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, mMeshWidth * mMeshHeight);
+		mCubeIndices.unbind();
+
+		// Clean up
+		if (cornerLocation >= 0)
+			glDisableVertexAttribArray(cornerLocation);
+		if (normalLocation >= 0)
+			glDisableVertexAttribArray(normalLocation);
+		if (uvLocation >= 0)
+			glDisableVertexAttribArray(uvLocation);
+		mCubeVertices.unbind();
+
+	}
+	else
+	{
+
+		// Draw the grid
+		shader.uniform("procedural", mMeshProcedural);
+		drawGrid();
+
+		// With level of detail on, the pass above only drew full 
+		// boxes. Billboards get their own pass, and points are 
+		// drawn by the pass-thru program, since the transform 
+		// program outputs triangles. Each is wrapped in a query.
+		if (lod)
+		{
+
+			// Collect any finished counts. If the GPU is so far
+			// behind that the next queries are still running, 
+			// this frame isn't counted.
+			readLevels();
+			bool query = !mLodQueryPending[mLodQueryFrame];
+			GLuint * queries = mLodQueries[mLodQueryFrame];
+
+			// Billboards
+			shader.uniform("lodLevel", 1);
+			if (query)
+				glBeginQuery(GL_PRIMITIVES_GENERATED_EXT, queries[0]);
+			drawGrid();
+			if (query)
+				glEndQuery(GL_PRIMITIVES_GENERATED_EXT);
+			shader.unbind();
+
+			// Points
+			bindShader(mShaderPassThru, transparent, lod);
+			mShaderPassThru.uniform("lodLevel", 2);
+			mShaderPassThru.uniform("procedural", mMeshProcedural);
+			if (query)
+				glBeginQuery(GL_PRIMITIVES_GENERATED_EXT, queries[1]);
+			drawGrid();
+			if (query)
+				glEndQuery(GL_PRIMITIVES_GENERATED_EXT);
+			mShaderPassThru.unbind();
+
+			// Read these once the GPU is done with them
+			if (query)
+			{
+				mLodQueryGrid[mLodQueryFrame] = mMeshWidth * mMeshHeight;
+				mLodQueryPending[mLodQueryFrame] = true;
+				mLodQueryFrame = (mLodQueryFrame + 1) % LOD_QUERY_FRAMES;
+			}
+
+		}
+
+	}
 
 	// Stop drawing
-	mShader.unbind();
+	shader.unbind();
+	if (mLightCount > 0)
+	{
+		mLightIndexTexture.unbind(2);
+		mLightGridTexture.unbind(1);
+		mLightDataTexture.unbind(0);
+	}
 	gl::popModelView();
 
-	// Draw the params interface
-	params::InterfaceGl::draw();
+}
+
+// Draws the mesh with weighted blended transparency
+void BoxApp::drawMeshTransparent()
+{
+
+	// Clear the color target to a revealage of one and 
+	// the weight target to zero
+	mOitFbo.bindFramebuffer();
+	glDrawBuffer(mOitAttachments[0]);
+	gl::clear(ColorAf(0.0f, 0.0f, 0.0f, 1.0f), false);
+	glDrawBuffer(mOitAttachments[1]);
+	gl::clear(ColorAf::zero(), false);
+	glDrawBuffers(2, mOitAttachments);
+
+	// Draw every layer. Depth testing would throw away the 
+	// layers behind, so turn it off. Color and weight add 
+	// up while the color target's alpha is multiplied by 
+	// (1 - alpha) for each layer.
+	glDisable(GL_DEPTH_TEST);
+	glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+	drawMesh(true);
+	mOitFbo.unbindFramebuffer();
+
+	// Resolve onto the screen with a window-sized quad
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl::pushMatrices();
+	gl::setMatricesWindow(getWindowSize());
+	mOitFbo.bindTexture(0, 0);
+	mOitFbo.bindTexture(1, 1);
+	mShaderResolve.bind();
+	mShaderResolve.uniform("colors", 0);
+	mShaderResolve.uniform("pixel", Vec2f(1.0f / (float)getWindowWidth(), 1.0f / (float)getWindowHeight()));
+	mShaderResolve.uniform("weights", 1);
+	gl::drawSolidRect(Rectf(getWindowBounds()));
+	mShaderResolve.unbind();
+	mOitFbo.getTexture(1).unbind(1);
+	mOitFbo.getTexture(0).unbind(0);
+	gl::popMatrices();
+	glEnable(GL_DEPTH_TEST);
+
+}
+
+// Pixels per unit of size at a distance of one, 
+// taken from the current projection
+float BoxApp::getLodScale()
+{
+	return gl::getProjection().at(1, 1) * (float)getWindowHeight() * 0.5f;
+}
+
+// Builds the cube used by the instanced backend. It has 24 
+// vertices, four per face, with the same corners, normals, and
+// UVs the geometry shader emits, so both backends look the same.
+void BoxApp::initCube()
+{
+
+	// Corner indices and UVs for each face, in the order 
+	// the geometry shader emits them as a triangle strip
+	static const int32_t faceCorners[6][4] = {
+		{ 5, 7, 4, 6 }, // Left
+		{ 3, 1, 2, 0 }, // Right
+		{ 7, 3, 6, 2 }, // Top
+		{ 1, 5, 0, 4 }, // Bottom
+		{ 3, 7, 1, 5 }, // Front
+		{ 6, 2, 4, 0 }  // Back
+	};
+	static const int32_t faceUvs[6][4] = {
+		{ 1, 2, 0, 3 }, 
+		{ 3, 0, 2, 1 }, 
+		{ 1, 2, 0, 3 }, 
+		{ 1, 2, 0, 3 }, 
+		{ 2, 3, 1, 0 }, 
+		{ 2, 1, 3, 0 }
+	};
+	static const Vec3f faceNormals[6] = {
+		Vec3f(-1.0f, 0.0f, 0.0f), 
+		Vec3f(1.0f, 0.0f, 0.0f), 
+		Vec3f(0.0f, 1.0f, 0.0f), 
+		Vec3f(0.0f, -1.0f, 0.0f), 
+		Vec3f(0.0f, 0.0f, 1.0f), 
+		Vec3f(0.0f, 0.0f, -1.0f)
+	};
+	static const Vec2f uvs[4] = { Vec2f(0.0f, 0.0f), Vec2f(1.0f, 0.0f), Vec2f(1.0f, 1.0f), Vec2f(0.0f, 1.0f) };
+
+	// Build interleaved vertices and triangle indices
+	vector<float> vertices;
+	vector<uint16_t> indices;
+	vertices.reserve(24 * 8);
+	indices.reserve(36);
+	for (int32_t face = 0; face < 6; face++)
+	{
+		for (int32_t i = 0; i < 4; i++)
+		{
+
+			// Corner bits are X, Y, Z, with 1 meaning positive
+			int32_t corner = faceCorners[face][i];
+			vertices.push_back((corner & 1) ? 1.0f : -1.0f);
+			vertices.push_back((corner & 2) ? 1.0f : -1.0f);
+			vertices.push_back((corner & 4) ? 1.0f : -1.0f);
+			vertices.push_back(faceNormals[face].x);
+			vertices.push_back(faceNormals[face].y);
+			vertices.push_back(faceNormals[face].z);
+			vertices.push_back(uvs[faceUvs[face][i]].x);
+			vertices.push_back(uvs[faceUvs[face][i]].y);
+
+		}
+
+		// Split the strip into two triangles
+		uint16_t base = (uint16_t)(face * 4);
+		indices.push_back(base);
+		indices.push_back(base + 1);
+		indices.push_back(base + 2);
+		indices.push_back(base + 2);
+		indices.push_back(base + 1);
+		indices.push_back(base + 3);
+	}
+
+	// Upload
+	mCubeVertices = gl::Vbo(GL_ARRAY_BUFFER);
+	mCubeVertices.bufferData(vertices.size() * sizeof(float), & vertices[0], GL_STATIC_DRAW);
+	mCubeVertices.unbind();
+	mCubeIndices = gl::Vbo(GL_ELEMENT_ARRAY_BUFFER);
+	mCubeIndices.bufferData(indices.size() * sizeof(uint16_t), & indices[0], GL_STATIC_DRAW);
+	mCubeIndices.unbind();
 
 }
 
@@ -158,6 +679,10 @@ void BoxApp::draw()
 void BoxApp::initMesh()
 {
 
+	// Allocate the grid up front
+	mVboIndices.reserve(mMeshWidth * mMeshHeight);
+	mVboVertices.reserve(mMeshWidth * mMeshHeight);
+
 	// Iterate through the grid dimensions
 	for (int32_t y = 0; y < mMeshHeight; y++)
 		for (int32_t x = 0; x < mMeshWidth; x++)
@@ -186,6 +711,7 @@ void BoxApp::initMesh()
 	mVboMesh.unbindBuffers();
 
 	// Clean up
+	mVboDirty = false;
 	mVboIndices.clear();
 	mVboVertices.clear();
 
@@ -202,12 +728,13 @@ void BoxApp::loadShader()
 	{
 
 		// Find maximum number of output vertices for geometry shader.
-		// We only need 32 to build a triangle strip box. If the GPU
-		// can't support 32 output vertices, it will draw as many as 
+		// The shader only emits the faces that face the eye. That's
+		// never more than three, so we need 12 vertices. If the GPU
+		// can't support 12 output vertices, it will draw as many as 
 		// it can.
 		int32_t maxGeomOutputVertices;
 		glGetIntegerv(GL_MAX_GEOMETRY_OUTPUT_VERTICES_EXT, & maxGeomOutputVertices);
-		maxGeomOutputVertices = math<int32_t>::min(maxGeomOutputVertices, 32);
+		maxGeomOutputVertices = math<int32_t>::min(maxGeomOutputVertices, 12);
 
 		// Get GLSL version
 		string glslVersion = string((const char *)glGetString(GL_SHADING_LANGUAGE_VERSION));
@@ -237,6 +764,8 @@ void BoxApp::loadShader()
 				loadResource(RES_SHADER_GEOM_150), 
 				GL_POINTS, GL_TRIANGLE_STRIP, maxGeomOutputVertices
 				);
+			bindFragData(mShaderPassThru);
+			bindFragData(mShaderTransform);
 
 		}
 		else
@@ -281,6 +810,54 @@ void BoxApp::loadShader()
 	// Use transform shader by default
 	mShader = mShaderTransform;
 
+	// Load the instanced backend separately. It needs 
+	// instanced drawing, so the app runs without it if 
+	// it doesn't compile. Corners are pinned to attribute 
+	// 0, which must be an enabled array. Locations only 
+	// take effect when linking, so we link again.
+	try
+	{
+		if (mGlslVersion >= 1.5)
+		{
+			mShaderInstanced = gl::GlslProg(loadResource(RES_SHADER_INSTANCED_VERT_150), loadResource(RES_SHADER_FRAG_150));
+			glBindAttribLocation(mShaderInstanced.getHandle(), 0, "cornerIn");
+			bindFragData(mShaderInstanced);
+		}
+		else
+		{
+			mShaderInstanced = gl::GlslProg(loadResource(RES_SHADER_INSTANCED_VERT_120), loadResource(RES_SHADER_FRAG_120));
+			glBindAttribLocation(mShaderInstanced.getHandle(), 0, "cornerIn");
+			glLinkProgram(mShaderInstanced.getHandle());
+		}
+	}
+	catch (gl::GlslProgCompileExc & ex)
+	{
+		trace("Instanced boxes not available.");
+		trace(ex.what());
+	}
+	catch (...)
+	{
+		trace("Instanced boxes not available.");
+	}
+
+	// The transparency resolve shader is optional, too
+	try
+	{
+		if (mGlslVersion >= 1.5)
+			mShaderResolve = gl::GlslProg(loadResource(RES_SHADER_RESOLVE_VERT_150), loadResource(RES_SHADER_RESOLVE_FRAG_150));
+		else
+			mShaderResolve = gl::GlslProg(loadResource(RES_SHADER_RESOLVE_VERT_120), loadResource(RES_SHADER_RESOLVE_FRAG_120));
+	}
+	catch (gl::GlslProgCompileExc & ex)
+	{
+		trace("Order independent transparency not available.");
+		trace(ex.what());
+	}
+	catch (...)
+	{
+		trace("Order independent transparency not available.");
+	}
+
 }
 
 // Handles mouse down event
@@ -348,6 +925,38 @@ void BoxApp::prepareSettings(ci::app::AppBasic::Settings * settings)
 
 }
 
+// Reads the level of detail counts from any queries the GPU
+// has finished, oldest first. Queries which aren't done yet
+// stay pending, and the last counts are kept.
+void BoxApp::readLevels()
+{
+	for (int32_t i = 0; i < LOD_QUERY_FRAMES; i++)
+	{
+
+		// Stop at the first query that's unused or still running, 
+		// so the counts never go back in time
+		int32_t frame = (mLodQueryFrame + i) % LOD_QUERY_FRAMES;
+		if (!mLodQueryPending[frame])
+			continue;
+		GLuint available = 0;
+		glGetQueryObjectuiv(mLodQueries[frame][1], GL_QUERY_RESULT_AVAILABLE, & available);
+		if (available == 0)
+			return;
+		mLodQueryPending[frame] = false;
+
+		// Each billboard is a strip of two triangles. Every point
+		// lands in exactly one level, so the rest are boxes.
+		GLuint billboardTriangles = 0;
+		GLuint points = 0;
+		glGetQueryObjectuiv(mLodQueries[frame][0], GL_QUERY_RESULT, & billboardTriangles);
+		glGetQueryObjectuiv(mLodQueries[frame][1], GL_QUERY_RESULT, & points);
+		mLodBillboardCount = (int32_t)(billboardTriangles / 2);
+		mLodPointCount = (int32_t)points;
+		mLodBoxCount = math<int32_t>::max(mLodQueryGrid[frame] - mLodBillboardCount - mLodPointCount, 0);
+
+	}
+}
+
 // Handles window resize event
 void BoxApp::resize(ResizeEvent event)
 {
@@ -375,6 +984,216 @@ void BoxApp::resize(ResizeEvent event)
 	glPointSize(3.0f);
 	gl::color(ColorAf::white());
 
+	// Size the transparency targets to the window
+	if (!mOitFbo || mOitFbo.getSize() != getWindowSize())
+	{
+		try
+		{
+			mOitFbo = gl::Fbo(getWindowWidth(), getWindowHeight(), mOitFormat);
+		}
+		catch (...)
+		{
+			trace("Unable to create transparency targets.");
+			mOitFbo = gl::Fbo();
+		}
+	}
+
+}
+
+// Compares the geometry shader and instanced backends
+// across grid sizes
+void BoxApp::runBenchmark()
+{
+
+	// Bail if instancing isn't available
+	if (!mShaderInstanced)
+	{
+		trace("Benchmark: instanced boxes not available");
+		return;
+	}
+
+	// Remember settings so we can restore them. Both backends
+	// draw from the procedural grid, so only box building differs.
+	bool boxEnabled = mBoxEnabled;
+	bool boxInstanced = mBoxInstanced;
+	bool lodEnabled = mLodEnabled;
+	bool meshProcedural = mMeshProcedural;
+	int32_t meshHeight = mMeshHeight;
+	int32_t meshWidth = mMeshWidth;
+	mBoxEnabled = true;
+	mLodEnabled = false;
+	mMeshProcedural = true;
+	mShader = mShaderTransform;
+	trace("Benchmark: grid, geometry shader ms, instanced ms, speed up");
+
+	// Sweep from 256x256 to 2048x2048
+	for (int32_t size = 256; size <= 2048; size *= 2)
+	{
+
+		// Set grid size
+		mMeshHeight = size;
+		mMeshWidth = size;
+
+		// Time each backend. We call glFinish() so we 
+		// measure the GPU's work, not just the submission.
+		double times[2];
+		for (int32_t i = 0; i < 2; i++)
+		{
+			mBoxInstanced = i == 1;
+			gl::setViewport(getWindowBounds());
+			gl::setMatrices(mCamera);
+			glFinish();
+			Timer timer(true);
+			for (int32_t frame = 0; frame < BENCHMARK_FRAMES; frame++)
+			{
+				gl::clear(mBackgroundColor, true);
+				drawMesh(false);
+				glFinish();
+			}
+			times[i] = timer.getSeconds() * 1000.0 / (double)BENCHMARK_FRAMES;
+		}
+
+		// Report
+		trace(toString(size) + "x" + toString(size) + ", " + toString(times[0]) + ", " + toString(times[1]) + ", " + toString(times[0] / math<double>::max(times[1], 0.000001)) + "x");
+
+	}
+
+	// Restore settings
+	mBoxEnabled = boxEnabled;
+	mBoxInstanced = boxInstanced;
+	mLodEnabled = lodEnabled;
+	mMeshProcedural = meshProcedural;
+	mMeshHeight = meshHeight;
+	mMeshWidth = meshWidth;
+	mShader = mBoxEnabled ? mShaderTransform : mShaderPassThru;
+
+}
+
+// Times 256 lights on a 512x512 grid with and without
+// culling, against the single light
+void BoxApp::runLightBenchmark()
+{
+
+	// Remember settings so we can restore them
+	bool boxEnabled = mBoxEnabled;
+	bool boxInstanced = mBoxInstanced;
+	int32_t lightCount = mLightCount;
+	bool lightCulling = mLightCulling;
+	bool lodEnabled = mLodEnabled;
+	bool meshProcedural = mMeshProcedural;
+	int32_t meshHeight = mMeshHeight;
+	int32_t meshWidth = mMeshWidth;
+	mBoxEnabled = true;
+	mBoxInstanced = false;
+	mLodEnabled = false;
+	mMeshProcedural = true;
+	mMeshHeight = 512;
+	mMeshWidth = 512;
+	mShader = mShaderTransform;
+	trace("Light benchmark: lights, culling, ms, lights per tile");
+
+	// One light, every light in every tile, then culled
+	int32_t counts[3] = { 0, LIGHT_MAX, LIGHT_MAX };
+	bool culling[3] = { true, false, true };
+	for (int32_t i = 0; i < 3; i++)
+	{
+
+		// Time the frame. We call glFinish() so we 
+		// measure the GPU's work, not just the submission.
+		mLightCount = counts[i];
+		mLightCulling = culling[i];
+		mLightsPerTile = 0.0f;
+		gl::setViewport(getWindowBounds());
+		gl::setMatrices(mCamera);
+		glFinish();
+		Timer timer(true);
+		for (int32_t frame = 0; frame < BENCHMARK_FRAMES; frame++)
+		{
+			gl::clear(mBackgroundColor, true);
+			drawMesh(false);
+			glFinish();
+		}
+		double time = timer.getSeconds() * 1000.0 / (double)BENCHMARK_FRAMES;
+
+		// Report
+		trace(toString(mLightCount + 1) + ", " + (mLightCulling ? "on" : "off") + ", " + toString(time) + ", " + toString(mLightsPerTile));
+
+	}
+
+	// Restore settings
+	mBoxEnabled = boxEnabled;
+	mBoxInstanced = boxInstanced;
+	mLightCount = lightCount;
+	mLightCulling = lightCulling;
+	mLodEnabled = lodEnabled;
+	mMeshProcedural = meshProcedural;
+	mMeshHeight = meshHeight;
+	mMeshWidth = meshWidth;
+	mShader = mBoxEnabled ? mShaderTransform : mShaderPassThru;
+
+}
+
+// Times the CPU wave against a plain sin() loop
+// across grid sizes
+void BoxApp::runWaveBenchmark()
+{
+
+	// Use the current wave
+	WaveField waveField;
+	waveField.setWave(mMeshWaveAmplitude, mElapsedSeconds, mMeshScale, mMeshWaveSpeed, mMeshWaveWidth);
+	trace("Wave benchmark: grid, scalar points/sec, SIMD points/sec, speed up, max error");
+
+	// Sweep from 256x256 to 2048x2048
+	for (int32_t size = 256; size <= 2048; size *= 2)
+	{
+
+		// Allocate input and output arrays
+		size_t count = (size_t)size * (size_t)size;
+		vector<float> x(count);
+		vector<float> y(count);
+		vector<float> z(count);
+		WaveField::fillGrid(size, size, & x[0], & y[0], & z[0]);
+		vector<float> outX(count);
+		vector<float> outY(count);
+		vector<float> outZ(count);
+		vector<float> refX(count);
+		vector<float> refY(count);
+		vector<float> refZ(count);
+
+		// Scalar reference, one thread
+		float amp = mMeshWaveAmplitude * mMeshScale;
+		float phase = mElapsedSeconds * mMeshWaveSpeed;
+		Timer timer(true);
+		for (int32_t frame = 0; frame < BENCHMARK_FRAMES; frame++)
+			for (size_t i = 0; i < count; i++)
+			{
+				float wave = math<float>::sin(phase + x[i] * mMeshWaveWidth) * amp;
+				refX[i] = mMeshScale * x[i];
+				refY[i] = mMeshScale * y[i] + wave;
+				refZ[i] = mMeshScale * z[i] - wave;
+			}
+		double scalarRate = (double)count * (double)BENCHMARK_FRAMES / math<double>::max(timer.getSeconds(), 0.000001);
+
+		// SIMD, every core
+		timer.start();
+		for (int32_t frame = 0; frame < BENCHMARK_FRAMES; frame++)
+			waveField.displace(& x[0], & y[0], & z[0], & outX[0], & outY[0], & outZ[0], count);
+		double simdRate = (double)count * (double)BENCHMARK_FRAMES / math<double>::max(timer.getSeconds(), 0.000001);
+
+		// Compare results
+		float error = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			error = math<float>::max(error, math<float>::abs(outX[i] - refX[i]));
+			error = math<float>::max(error, math<float>::abs(outY[i] - refY[i]));
+			error = math<float>::max(error, math<float>::abs(outZ[i] - refZ[i]));
+		}
+
+		// Report
+		trace(toString(size) + "x" + toString(size) + ", " + toString(scalarRate) + ", " + toString(simdRate) + ", " + toString(simdRate / math<double>::max(scalarRate, 0.000001)) + "x, " + toString(error));
+
+	}
+
 }
 
 // Take screen shot
@@ -397,6 +1216,18 @@ void BoxApp::setup()
 	mVboLayout.setStaticIndices();
 	mVboLayout.setStaticPositions();
 
+	// Transparency uses two floating point color targets. We
+	// write to both at once, so the attachments are held
+	// in an array.
+	mOitAttachments[0] = GL_COLOR_ATTACHMENT0_EXT;
+	mOitAttachments[1] = GL_COLOR_ATTACHMENT1_EXT;
+	mOitEnabled = false;
+	mOitFormat.enableDepthBuffer(false);
+	mOitFormat.enableColorBuffer(true, 2);
+	mOitFormat.setMinFilter(GL_NEAREST);
+	mOitFormat.setMagFilter(GL_NEAREST);
+	mOitFormat.setColorInternalFormat(GL_RGBA_FLOAT32_ATI);
+
 	// Intialize camera
 	mEyePoint = Vec3f::zero();
 	mLookAt = Vec3f::zero();
@@ -416,6 +1247,23 @@ void BoxApp::setup()
 	mBoxEnabled = true;
 	mBoxEnabledPrev = mBoxEnabled;
 	mBoxRotationSpeed = 0.01f;
+	mBoxInstanced = false;
+
+	// Boxes under 8 pixels become billboards, and 
+	// under 2 pixels become points
+	mLodBillboardCount = 0;
+	mLodBillboardSize = 8.0f;
+	mLodBoxCount = 0;
+	mLodEnabled = false;
+	mLodPointCount = 0;
+	mLodPointSize = 2.0f;
+	mLodQueryFrame = 0;
+	glGenQueries(LOD_QUERY_FRAMES * 2, & mLodQueries[0][0]);
+	for (int32_t i = 0; i < LOD_QUERY_FRAMES; i++)
+	{
+		mLodQueryGrid[i] = 0;
+		mLodQueryPending[i] = false;
+	}
 
 	// Set default mesh dimensions
 	mMeshAlpha = 0.8f;
@@ -430,6 +1278,10 @@ void BoxApp::setup()
 	mMeshWaveWidth = 0.105f;
 	mMeshWidth = 112;
 	mMeshWidthPrev = mMeshWidth;
+	mMeshProcedural = false;
+	mMeshProceduralPrev = mMeshProcedural;
+	mProceduralVertexCount = 0;
+	mVboDirty = true;
 
 	// Set up the light. This application does not actually use OpenGL 
 	// lighting. Instead, it passes a light position and color 
@@ -440,8 +1292,27 @@ void BoxApp::setup()
 	mLightShininess = 20.0f;
 	mLightSpecular = ColorAf(0.75f, 0.75f, 0.75f, 1.0f);
 
+	// Scatter the clustered lights. Light data is uploaded as 
+	// float textures, sampled without filtering.
+	Rand rand(1);
+	for (int32_t i = 0; i < LIGHT_MAX; i++)
+	{
+		mLightColors.push_back(Colorf(rand.nextFloat(0.1f, 0.6f), rand.nextFloat(0.1f, 0.6f), rand.nextFloat(0.1f, 0.6f)));
+		mLightOrigins.push_back(Vec4f(rand.nextFloat(-0.5f, 0.5f), rand.nextFloat(-0.5f, 0.5f), rand.nextFloat(-0.5f, 0.5f), rand.nextFloat(0.0f, 6.2831853f)));
+	}
+	mLightCount = 0;
+	mLightCulling = true;
+	mLightRadius = 24.0f;
+	mLightsPerTile = 0.0f;
+	mLightTextureFormat.setInternalFormat(GL_RGBA_FLOAT32_ATI);
+	mLightTextureFormat.setMinFilter(GL_NEAREST);
+	mLightTextureFormat.setMagFilter(GL_NEAREST);
+	mLightTextureFormat.setWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+	mLightData = Surface32f(LIGHT_MAX, 2, true, SurfaceChannelOrder::RGBA);
+	mLightDataTexture = gl::Texture(mLightData, mLightTextureFormat);
+
 	// Create the parameters bar
-	mParams = params::InterfaceGl("Parameters", Vec2i(250, 400));
+	mParams = params::InterfaceGl("Parameters", Vec2i(250, 560));
 	mParams.addSeparator("");
 	mParams.addText("Hold ALT to rotate");
 	mParams.addText("Hold SHIFT to drag");
@@ -450,23 +1321,48 @@ void BoxApp::setup()
 	mParams.addParam("Box transform enabled", & mBoxEnabled, "key=a");
 	mParams.addParam("Box rotation speed", & mBoxRotationSpeed, "min=0.00000 max=1.00000 step=0.00001 keyDecr=b keyIncr=B");
 	mParams.addParam("Box dimensions", & mBoxDimensions);
+	mParams.addParam("Box instanced", & mBoxInstanced, "key=k");
+	mParams.addSeparator("");
+	mParams.addParam("LOD enabled", & mLodEnabled, "key=o");
+	mParams.addParam("LOD billboard size", & mLodBillboardSize, "min=0.0 max=1000.0 step=0.5 keyDecr=p keyIncr=P");
+	mParams.addParam("LOD point size", & mLodPointSize, "min=0.0 max=1000.0 step=0.5 keyDecr=q keyIncr=Q");
+	mParams.addParam("LOD boxes", & mLodBoxCount, "", true);
+	mParams.addParam("LOD billboards", & mLodBillboardCount, "", true);
+	mParams.addParam("LOD points", & mLodPointCount, "", true);
 	mParams.addSeparator("");
 	mParams.addParam("Mesh height", & mMeshHeight, "min=1 max=2048 step=1 keyDecr=c keyIncr=C");
 	mParams.addParam("Mesh width", & mMeshWidth, "min=1 max=2048 step=1 keyDecr=d keyIncr=D");
+	mParams.addParam("Mesh procedural", & mMeshProcedural, "key=j");
 	mParams.addParam("Mesh scale", & mMeshScale, "min=0.1 max=30000.0 step=0.1 keyDecr=e keyIncr=E");
 	mParams.addParam("Mesh wave amplitude", & mMeshWaveAmplitude, "min=0.000 max=30000.000 step=0.001 keyDecr=f keyIncr=F");
 	mParams.addParam("Mesh wave speed", & mMeshWaveSpeed, "min=0.000 max=100.000 step=0.001 keyDecr=g keyIncr=G");
 	mParams.addParam("Mesh wave width", & mMeshWaveWidth, "min=0.000 max=30000.000 step=0.001 keyDecr=h keyIncr=H");
 	mParams.addSeparator("");
 	mParams.addParam("Light position", & mLightPosition);
+	mParams.addParam("Light count", & mLightCount, "min=0 max=256 step=1 keyDecr=r keyIncr=R");
+	mParams.addParam("Light radius", & mLightRadius, "min=1.0 max=1000.0 step=1.0 keyDecr=s keyIncr=S");
+	mParams.addParam("Light culling", & mLightCulling, "key=t");
+	mParams.addParam("Lights per tile", & mLightsPerTile, "", true);
+	mParams.addSeparator("");
+	mParams.addParam("Order independent transparency", & mOitEnabled, "key=n");
 	mParams.addSeparator("");
 	mParams.addParam("Frame rate", & mFrameRate, "", true);
 	mParams.addParam("Full screen", & mFullScreen, "key=i");
+	mParams.addButton("Run benchmark", std::bind(& BoxApp::runBenchmark, this), "key=l");
+	mParams.addButton("Run light benchmark", std::bind(& BoxApp::runLightBenchmark, this), "key=u");
+	mParams.addButton("Run wave benchmark", std::bind(& BoxApp::runWaveBenchmark, this), "key=m");
 	mParams.addButton("Save screen shot", std::bind(& BoxApp::screenShot, this), "key=space");
 	mParams.addButton("Quit", std::bind(& BoxApp::quit, this), "key=esc");
 	
-	// Create mesh
-	initMesh();
+	// Create the shared cube for instanced boxes
+	initCube();
+
+	// Create mesh. The procedural grid doesn't need one, 
+	// so we just reset the view.
+	if (mMeshProcedural)
+		resize(ResizeEvent(getWindowSize()));
+	else
+		initMesh();
 
 }
 
@@ -475,10 +1371,39 @@ void BoxApp::shutdown()
 {
 
 	// Clean up
+	if (mCubeIndices)
+		mCubeIndices.reset();
+	if (mCubeVertices)
+		mCubeVertices.reset();
+	mLightColors.clear();
+	if (mLightData)
+		mLightData.reset();
+	if (mLightDataTexture)
+		mLightDataTexture.reset();
+	if (mLightGrid)
+		mLightGrid.reset();
+	if (mLightGridTexture)
+		mLightGridTexture.reset();
+	if (mLightIndices)
+		mLightIndices.reset();
+	if (mLightIndexTexture)
+		mLightIndexTexture.reset();
+	mLightOrigins.clear();
+	mLightRects.clear();
+	mLightTileCursors.clear();
+	glDeleteQueries(LOD_QUERY_FRAMES * 2, & mLodQueries[0][0]);
+	if (mOitFbo)
+		mOitFbo.reset();
+	if (mProceduralVertices)
+		mProceduralVertices.reset();
 	if (mShader)
 		mShader.reset();
+	if (mShaderInstanced)
+		mShaderInstanced.reset();
 	if (mShaderPassThru)
 		mShaderPassThru.reset();
+	if (mShaderResolve)
+		mShaderResolve.reset();
 	if (mShaderTransform)
 		mShaderTransform.reset();
 	mVboIndices.clear();
@@ -511,15 +1436,33 @@ void BoxApp::update()
 	mElapsedSeconds = (float)getElapsedSeconds();
 	mFrameRate = getAverageFps();
 
-	// Update mesh if dimensions change
+	// Update mesh if dimensions change. The procedural grid
+	// reads its size from uniforms, so the VBO is only rebuilt 
+	// when it's used again. Either way, the view is reset.
 	if (mMeshHeight != mMeshHeightPrev || 
 		mMeshWidth != mMeshWidthPrev)
 	{
-		initMesh();
+		if (mMeshProcedural)
+		{
+			mVboDirty = true;
+			resize(ResizeEvent(getWindowSize()));
+		}
+		else
+		{
+			initMesh();
+		}
 		mMeshHeightPrev = mMeshHeight;
 		mMeshWidthPrev = mMeshWidth;
 	}
 
+	// Toggle procedural mode
+	if (mMeshProcedural != mMeshProceduralPrev)
+	{
+		if (!mMeshProcedural && mVboDirty)
+			initMesh();
+		mMeshProceduralPrev = mMeshProcedural;
+	}
+
 	// Toggle fullscreen mode
 	if (mFullScreen != mFullScreenPrev)
 	{
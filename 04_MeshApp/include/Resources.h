@@ -4,11 +4,23 @@
 // Shaders
 #define RES_SHADER_FBO_FRAG_120		CINDER_RESOURCE(../resources/, fbo_frag_120.fs, 128, GLSL)
 #define RES_SHADER_FBO_VERT_120		CINDER_RESOURCE(../resources/, fbo_vert_120.vs, 129, GLSL)
+#define RES_SHADER_FEEDBACK_VERT_120	CINDER_RESOURCE(../resources/, feedback_vert_120.vs, 142, GLSL)
+#define RES_SHADER_MESH_VERT_120	CINDER_RESOURCE(../resources/, mesh_vert_120.vs, 145, GLSL)
+#define RES_SHADER_RESOLVE_FRAG_120	CINDER_RESOURCE(../resources/, resolve_frag_120.glsl, 138, GLSL)
+#define RES_SHADER_RESOLVE_VERT_120	CINDER_RESOURCE(../resources/, resolve_vert_120.glsl, 140, GLSL)
+#define RES_SHADER_SIM_FRAG_120	CINDER_RESOURCE(../resources/, sim_frag_120.fs, 152, GLSL)
+#define RES_SHADER_STRIP_VERT_120	CINDER_RESOURCE(../resources/, strip_vert_120.vs, 150, GLSL)
 #define RES_SHADER_VBO_FRAG_120		CINDER_RESOURCE(../resources/, vbo_frag_120.fs, 130, GLSL)
 #define RES_SHADER_VBO_GEOM_120		CINDER_RESOURCE(../resources/, vbo_geom_120.gs, 131, GLSL)
 #define RES_SHADER_VBO_VERT_120		CINDER_RESOURCE(../resources/, vbo_vert_120.vs, 132, GLSL)
 #define RES_SHADER_FBO_FRAG_150		CINDER_RESOURCE(../resources/, fbo_frag_150.glsl, 133, GLSL)
 #define RES_SHADER_FBO_VERT_150		CINDER_RESOURCE(../resources/, fbo_vert_150.glsl, 134, GLSL)
+#define RES_SHADER_FEEDBACK_VERT_150	CINDER_RESOURCE(../resources/, feedback_vert_150.glsl, 143, GLSL)
+#define RES_SHADER_MESH_VERT_150	CINDER_RESOURCE(../resources/, mesh_vert_150.glsl, 147, GLSL)
+#define RES_SHADER_RESOLVE_FRAG_150	CINDER_RESOURCE(../resources/, resolve_frag_150.glsl, 139, GLSL)
+#define RES_SHADER_RESOLVE_VERT_150	CINDER_RESOURCE(../resources/, resolve_vert_150.glsl, 141, GLSL)
+#define RES_SHADER_SIM_FRAG_150	CINDER_RESOURCE(../resources/, sim_frag_150.glsl, 153, GLSL)
+#define RES_SHADER_STRIP_VERT_150	CINDER_RESOURCE(../resources/, strip_vert_150.glsl, 151, GLSL)
 #define RES_SHADER_VBO_FRAG_150		CINDER_RESOURCE(../resources/, vbo_frag_150.glsl, 135, GLSL)
 #define RES_SHADER_VBO_GEOM_150		CINDER_RESOURCE(../resources/, vbo_geom_150.glsl, 136, GLSL)
 #define RES_SHADER_VBO_VERT_150		CINDER_RESOURCE(../resources/, vbo_vert_150.glsl, 137, GLSL)
@@ -2,27 +2,59 @@
 
 // Uniforms
 uniform float amp;
+uniform vec2 extent;
+uniform sampler2D heights;
+uniform vec2 normalDecode;
 uniform float phase;
+uniform vec2 pixel;
+uniform vec2 positionDecode;
 uniform sampler2D positions;
 uniform float scale;
+uniform bool simulate;
 uniform float speed;
 uniform float width;
 
 // Input attributes
 varying vec4 uv;
 
+// Displaces the point at a texture coordinate. Lookups 
+// are clamped to the centers of the texels in use.
+vec3 wavePosition(vec2 coord)
+{
+
+	// Read position from color value. Only x and y 
+	// are stored; the grid starts out flat.
+	coord = clamp(coord, pixel * 0.5, extent + pixel * 0.5);
+	vec3 position = vec3(texture2D(positions, coord).rg, 0.0);
+
+	// Use uniforms to update position. A simulation's 
+	// heights replace the sine wave.
+	float wave = simulate ? texture2D(heights, coord).r : sin((phase * speed) + position.x * width);
+	wave *= amp * scale;
+	return vec3(scale * position.x, scale * position.y + wave, scale * position.z - wave);
+
+}
+
 // Kernel
 void main(void)
 {
 
-	// Read position from color value
-	vec3 position = texture2D(positions, uv.st).rgb;
+	// Displace this point and its neighbors
+	vec3 position = wavePosition(uv.st);
+	vec3 left = wavePosition(uv.st - vec2(pixel.x, 0.0));
+	vec3 right = wavePosition(uv.st + vec2(pixel.x, 0.0));
+	vec3 top = wavePosition(uv.st - vec2(0.0, pixel.y));
+	vec3 bottom = wavePosition(uv.st + vec2(0.0, pixel.y));
+
+	// Central differences give a smooth normal, perpendicular
+	// to both directions across the mesh
+	vec3 normal = normalize(cross(bottom - top, right - left));
 
-	// Use uniforms to update position
-	float wave = (sin((phase * speed) + position.x * width)) * (amp * scale);
-	position = vec3(scale * position.x, scale * position.y + wave, scale * position.z - wave);
+	// Render position to the first attachment, scaled to fit
+	// the FBO's format
+	gl_FragData[0] = vec4((position - positionDecode.y) / positionDecode.x, 1.0);
 
-	// Render position to color attachment
-	gl_FragData[0] = vec4(position.x, position.y, position.z, 1.0);
+	// Render normal to the second attachment
+	gl_FragData[1] = vec4((normal - normalDecode.y) / normalDecode.x, 1.0);
 
 }
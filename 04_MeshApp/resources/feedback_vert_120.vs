@@ -0,0 +1,59 @@
+#version 120
+
+// Uniforms
+uniform float amp;
+uniform vec2 extent;
+uniform float phase;
+uniform vec2 pixel;
+uniform sampler2D positions;
+uniform float scale;
+uniform float speed;
+uniform float width;
+
+// Output attributes. These are captured into a 
+// vertex buffer instead of being rasterized.
+varying vec4 normal;
+varying vec4 position;
+varying vec4 uv;
+
+// Displaces the point at a texture coordinate. Lookups 
+// are clamped to the centers of the texels in use, the
+// same way as the wave pass.
+vec3 wavePosition(vec2 coord)
+{
+
+	// Read position from color value. Only x and y 
+	// are stored; the grid starts out flat.
+	coord = clamp(coord, pixel * 0.5, extent + pixel * 0.5);
+	vec3 point = vec3(texture2D(positions, coord).rg, 0.0);
+
+	// Use uniforms to update position
+	float wave = (sin((phase * speed) + point.x * width)) * (amp * scale);
+	return vec3(scale * point.x, scale * point.y + wave, scale * point.z - wave);
+
+}
+
+// Kernel
+void main(void)
+{
+
+	// Displace this point and its neighbors. Lookups are
+	// made at the texel's center.
+	vec4 texCoord = gl_MultiTexCoord0;
+	vec2 coord = texCoord.st + pixel * 0.5;
+	vec3 point = wavePosition(coord);
+	vec3 left = wavePosition(coord - vec2(pixel.x, 0.0));
+	vec3 right = wavePosition(coord + vec2(pixel.x, 0.0));
+	vec3 top = wavePosition(coord - vec2(0.0, pixel.y));
+	vec3 bottom = wavePosition(coord + vec2(0.0, pixel.y));
+
+	// Central differences give the same smooth normal the
+	// wave pass writes for the point and strip modes
+	normal = vec4(normalize(cross(bottom - top, right - left)), 0.0);
+
+	// Write position and a coordinate which spans the mesh
+	position = vec4(point.x, point.y, point.z, 1.0);
+	uv = vec4(texCoord.st / (extent + pixel), texCoord.pq);
+	gl_Position = position;
+
+}
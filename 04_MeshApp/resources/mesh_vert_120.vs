@@ -0,0 +1,24 @@
+#version 120
+
+// Uniforms
+uniform mat4 mvp;
+
+// Output attributes
+varying vec4 gsNormal;
+varying vec4 gsPosition;
+varying vec4 gsuv;
+
+// Kernel
+void main(void)
+{
+
+	// The vertex buffer already holds displaced positions
+	// and smooth normals. Turn the normal with the mesh.
+	gsPosition = gl_Vertex;
+	gsNormal = vec4(normalize((mvp * vec4(gl_Normal, 0.0)).xyz), 0.0);
+	gsuv = gl_MultiTexCoord0;
+
+	// Set position
+	gl_Position = mvp * gsPosition;
+
+}
@@ -0,0 +1,26 @@
+// Adding the word "compatibility" let's us use 
+// legacy built-in uniforms
+#version 150 compatibility
+
+// Uniforms
+uniform mat4 mvp;
+
+// Output attributes
+out vec4 normal;
+out vec4 position;
+out vec4 uv;
+
+// Kernel
+void main(void)
+{
+
+	// The vertex buffer already holds displaced positions
+	// and smooth normals. Turn the normal with the mesh.
+	position = mvp * gl_Vertex;
+	normal = vec4(normalize((mvp * vec4(gl_Normal, 0.0)).xyz), 0.0);
+	uv = gl_MultiTexCoord0;
+
+	// Set position
+	gl_Position = position;
+
+}
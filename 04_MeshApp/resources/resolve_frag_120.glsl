@@ -0,0 +1,24 @@
+#version 120
+
+// Uniforms
+uniform sampler2D colors;
+uniform vec2 pixel;
+uniform sampler2D weights;
+
+// Kernel
+void main(void)
+{
+
+	// Read accumulated color and revealage. Revealage is 
+	// the product of (1 - alpha) for every layer, so one 
+	// means nothing covered this pixel.
+	vec4 color = texture2D(colors, gl_FragCoord.xy * pixel);
+	if (color.a >= 1.0)
+		discard;
+
+	// Divide out the weights to get the average color, 
+	// then cover the background by the amount hidden
+	float weight = texture2D(weights, gl_FragCoord.xy * pixel).r;
+	gl_FragColor = vec4(color.rgb / max(weight, 0.00001), 1.0 - color.a);
+
+}
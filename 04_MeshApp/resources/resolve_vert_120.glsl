@@ -0,0 +1,10 @@
+#version 120
+
+// Kernel
+void main()
+{
+
+	// Pass position through
+	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+
+}
@@ -0,0 +1,12 @@
+// Adding the word "compatibility" lets us use 
+// legacy built-in uniforms
+#version 150 compatibility
+
+// Kernel
+void main()
+{
+
+	// Pass position through
+	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+
+}
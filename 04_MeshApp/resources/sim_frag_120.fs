@@ -0,0 +1,47 @@
+#version 120
+
+// Uniforms
+uniform float damping;
+uniform vec4 drop;
+uniform vec2 extent;
+uniform vec2 pixel;
+uniform float speed;
+uniform sampler2D state;
+
+// Input attributes
+varying vec4 uv;
+
+// Reads the current and previous height at a texture 
+// coordinate. Lookups are clamped to the centers of the 
+// texels in use, so waves reflect off the edges.
+vec2 readState(vec2 coord)
+{
+	return texture2D(state, clamp(coord, pixel * 0.5, extent + pixel * 0.5)).rg;
+}
+
+// Kernel
+void main(void)
+{
+
+	// Read this height and its neighbors
+	vec2 center = readState(uv.st);
+	float left = readState(uv.st - vec2(pixel.x, 0.0)).r;
+	float right = readState(uv.st + vec2(pixel.x, 0.0)).r;
+	float top = readState(uv.st - vec2(0.0, pixel.y)).r;
+	float bottom = readState(uv.st + vec2(0.0, pixel.y)).r;
+
+	// Step the wave equation. The height's velocity is the 
+	// difference from the last step, which damping slows down.
+	float laplacian = left + right + top + bottom - 4.0 * center.r;
+	float height = center.r + (center.r - center.g) * damping + speed * laplacian;
+
+	// Add a drop. Its position is a texture coordinate and 
+	// its radius is in texels.
+	float distance = length((uv.st - drop.xy) / pixel);
+	if (distance < drop.z)
+		height += drop.w * (0.5 + 0.5 * cos(3.14159265 * distance / drop.z));
+
+	// Render the new height, keeping this one as the previous
+	gl_FragData[0] = vec4(height, center.r, 0.0, 1.0);
+
+}
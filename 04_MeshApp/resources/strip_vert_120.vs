@@ -0,0 +1,47 @@
+#version 120
+
+// Uniforms
+uniform vec2 extent;
+uniform mat4 mvp;
+uniform vec2 normalDecode;
+uniform sampler2D normals;
+uniform vec2 pixel;
+uniform vec2 positionDecode;
+uniform sampler2D positions;
+
+// Output attributes
+varying vec4 gsNormal;
+varying vec4 gsPosition;
+varying vec4 gsuv;
+
+// Reads a normal from the FBO's second attachment and
+// turns it with the mesh
+vec4 readNormal(vec2 coord)
+{
+	vec3 normal = texture2D(normals, coord).xyz * normalDecode.x + normalDecode.y;
+	return vec4(normalize((mvp * vec4(normal, 0.0)).xyz), 0.0);
+}
+
+// Reads a position from the FBO. Positions may be stored
+// in a normalized format, so they're scaled back out here.
+vec4 readPosition(vec2 coord)
+{
+	return vec4(texture2D(positions, coord).xyz * positionDecode.x + positionDecode.y, 1.0);
+}
+
+// Kernel
+void main(void)
+{
+
+	// Read position and normal from the FBO
+	vec4 texCoord = gl_MultiTexCoord0;
+	gsPosition = readPosition(texCoord.st);
+	gsNormal = readNormal(texCoord.st);
+
+	// Rescale the coordinate to span the mesh
+	gsuv = vec4(texCoord.st / (extent + pixel), texCoord.pq);
+
+	// Set position
+	gl_Position = mvp * gsPosition;
+
+}
@@ -7,6 +7,8 @@ uniform vec4 lightAmbient;
 uniform vec4 lightDiffuse;
 uniform vec4 lightSpecular;
 uniform vec3 lightPosition;
+uniform bool oit;
+uniform float oitDepth;
 uniform float shininess;
 uniform bool transform;
 uniform float uvmix;
@@ -57,7 +59,21 @@ void main(void)
 	
 	}
 
-	// Set final color
-	gl_FragColor = color;
+	// Set final color. When drawing order independent 
+	// transparency, weight color by depth so nearer surfaces 
+	// count for more, then premultiply. Alpha is left as is 
+	// so the blend keeps the product of (1 - alpha) in the 
+	// first target.
+	if (oit)
+	{
+		float w = clamp(0.03 / (0.00001 + pow((1.0 / gl_FragCoord.w) / oitDepth, 4.0)), 0.01, 3000.0);
+		gl_FragData[0] = vec4(color.rgb * color.a * w, color.a);
+		gl_FragData[1] = vec4(color.a * w);
+	}
+	else
+	{
+		gl_FragData[0] = color;
+		gl_FragData[1] = vec4(0.0, 0.0, 0.0, 0.0);
+	}
 
 }
@@ -7,6 +7,8 @@ uniform vec4 lightAmbient;
 uniform vec4 lightDiffuse;
 uniform vec4 lightSpecular;
 uniform vec3 lightPosition;
+uniform bool oit;
+uniform float oitDepth;
 uniform float shininess;
 uniform bool transform;
 uniform float uvmix;
@@ -16,8 +18,10 @@ in vec4 normal;
 in vec4 position;
 in vec4 uv;
 
-// Output attributes
+// Output attributes. Weight is only written to when 
+// drawing order independent transparency.
 out vec4 color;
+out vec4 weight;
 
 // Kernel
 void main(void)
@@ -60,4 +64,15 @@ void main(void)
 	
 	}
 
+	// Weight color by depth so nearer surfaces count for more, 
+	// then premultiply. Alpha is left as is so the blend keeps 
+	// the product of (1 - alpha) in the first target.
+	weight = vec4(0.0, 0.0, 0.0, 0.0);
+	if (oit)
+	{
+		float w = clamp(0.03 / (0.00001 + pow((1.0 / gl_FragCoord.w) / oitDepth, 4.0)), 0.01, 3000.0);
+		weight = vec4(color.a * w);
+		color = vec4(color.rgb * color.a * w, color.a);
+	}
+
 }
\ No newline at end of file
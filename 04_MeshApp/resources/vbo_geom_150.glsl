@@ -1,8 +1,12 @@
 #version 150
 
 // Uniforms
+uniform vec2 extent;
 uniform mat4 mvp;
+uniform vec2 normalDecode;
+uniform sampler2D normals;
 uniform vec2 pixel;
+uniform vec2 positionDecode;
 uniform sampler2D positions;
 uniform bool transform;
 
@@ -29,38 +33,61 @@ void addVertex(vec4 vert, vec4 norm)
 
 }
 
+// Reads a normal from the FBO's second attachment and
+// turns it with the mesh
+vec4 readNormal(vec2 coord)
+{
+	vec3 normal = texture2D(normals, coord).xyz * normalDecode.x + normalDecode.y;
+	return vec4(normalize((mvp * vec4(normal, 0.0)).xyz), 0.0);
+}
+
+// Reads a position from the FBO. Positions may be stored
+// in a normalized format, so they're scaled back out here.
+vec4 readPosition(vec2 coord)
+{
+	return vec4(texture2D(positions, coord).xyz * positionDecode.x + positionDecode.y, 1.0);
+}
+
 // Kernel
 void main(void)
 {
 
-	// Passes vertex and texture coordinate to fragment shader
+	// Passes vertex and texture coordinate to fragment shader.
+	// The coordinate is rescaled to span the mesh.
 	position = mvp * vertex[0];
-	uv = texCoord[0];
+	uv = vec4(texCoord[0].st / (extent + pixel), texCoord[0].pq);
 
 	// Transform point to box
 	if (transform)
 	{
 
-		// Find corners of quad
+		// Find corners of quad. The texture can be larger than
+		// the mesh, so neighbors are clamped to the last texel
+		// in use, the same as clamping at the texture's edge.
+		vec2 coord1 = min(texCoord[0].st + vec2(pixel.x, 0.0), extent);
+		vec2 coord2 = min(texCoord[0].st + pixel, extent);
+		vec2 coord3 = min(texCoord[0].st + vec2(0.0, pixel.y), extent);
 		vec4 vert0 = position;
-		vec4 vert1 = mvp * texture2D(positions, uv.st + vec2(pixel.x, 0.0));
-		vec4 vert2 = mvp * texture2D(positions, uv.st + pixel);
-		vec4 vert3 = mvp * texture2D(positions, uv.st + vec2(0.0, pixel.y));
+		vec4 vert1 = mvp * readPosition(coord1);
+		vec4 vert2 = mvp * readPosition(coord2);
+		vec4 vert3 = mvp * readPosition(coord3);
 
-		// Calculate normals
-		vec4 norm0 = vec4(normalize(cross(vec3(vert1.xyz - vert0.xyz), vec3(vert1.xyz - vert3.xyz))), 0.0);
-		vec4 norm1 = vec4(normalize(cross(vec3(vert2.xyz - vert1.xyz), vec3(vert2.xyz - vert3.xyz))), 0.0);
+		// Read each corner's normal from the wave pass
+		vec4 norm0 = readNormal(texCoord[0].st);
+		vec4 norm1 = readNormal(coord1);
+		vec4 norm2 = readNormal(coord2);
+		vec4 norm3 = readNormal(coord3);
 
 		// Left triangle
 		addVertex(vert0, norm0);
-		addVertex(vert3, norm0);
-		addVertex(vert1, norm0);
+		addVertex(vert3, norm3);
+		addVertex(vert1, norm1);
 		EndPrimitive();
 
 		// Right triangle
 		addVertex(vert1, norm1);
-		addVertex(vert3, norm1);
-		addVertex(vert2, norm1);
+		addVertex(vert3, norm3);
+		addVertex(vert2, norm2);
 		EndPrimitive();
 
 	}
@@ -2,19 +2,27 @@
 
 // Uniforms
 uniform mat4 mvp;
+uniform vec2 positionDecode;
 uniform sampler2D positions;
 
 // Output attributes
 varying vec4 vertex;
 varying vec4 texCoord;
 
+// Reads a position from the FBO. Positions may be stored
+// in a normalized format, so they're scaled back out here.
+vec4 readPosition(vec2 coord)
+{
+	return vec4(texture2D(positions, coord).xyz * positionDecode.x + positionDecode.y, 1.0);
+}
+
 // Kernel
 void main(void)
 {
 
 	// Set output attributes
 	texCoord = gl_MultiTexCoord0;
-	vertex = texture2D(positions, texCoord.xy);
+	vertex = readPosition(texCoord.xy);
 
 	// Set position
 	gl_Position = vertex;
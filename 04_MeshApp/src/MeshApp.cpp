@@ -7,8 +7,15 @@
 #include <cinder/gl/Vbo.h>
 #include <cinder/ImageIo.h>
 #include <cinder/params/Params.h>
+#include <cinder/Rand.h>
+#include <cinder/Thread.h>
+#include <cinder/Timer.h>
 #include <cinder/Utilities.h>
+#include <cstdio>
+#include <deque>
+#include <iomanip>
 #include "Resources.h"
+#include <WaveField.h>
 
 /*
  * This application demonstrates how to create and update a
@@ -19,6 +26,118 @@
  * impossible with a VBO alone.
  */
 
+// A candidate format for the FBO's positions. Normalized 
+// formats only hold values between zero and one, so positions
+// are written with a scale and bias which the shaders undo.
+struct PositionFormat
+{
+	PositionFormat(const std::string & name, GLint internalFormat, GLenum type, int32_t bytes, bool normalized, int32_t maxSize)
+		: mBytes(bytes), mInternalFormat(internalFormat), mMaxSize(maxSize), mName(name), 
+		mNormalized(normalized), mRenderable(false), mTested(false), mType(type)
+	{
+	}
+	int32_t mBytes;
+	GLint mInternalFormat;
+	int32_t mMaxSize;
+	std::string mName;
+	bool mNormalized;
+	bool mRenderable;
+	bool mTested;
+	GLenum mType;
+};
+
+// Writes a sequence of meshes, one file per frame. Frames are
+// copied into a fixed pool of buffers and written by a background
+// thread. When every buffer is waiting on the disk, new frames 
+// are dropped and counted instead of queued, so memory stays
+// bounded and the render thread never waits.
+class MeshExporter
+{
+
+public:
+
+	// File formats
+	enum
+	{
+		FORMAT_PLY, 
+		FORMAT_OBJ
+	};
+
+	// A frame's pixels as read from the FBO, and the positions 
+	// the writer thread decodes from them, three floats per point
+	struct Frame
+	{
+		std::vector<uint8_t> mData;
+		ci::Vec2f mDecode;
+		int32_t mHeight;
+		uint32_t mIndex;
+		std::vector<float> mPositions;
+		GLenum mType;
+		int32_t mWidth;
+	};
+
+	MeshExporter();
+	~MeshExporter();
+
+	// Returns an empty frame from the pool with room for 
+	// "bytes" per point, or null if the writer is behind 
+	// and the frame was dropped
+	Frame * acquire(int32_t width, int32_t height, int32_t bytes);
+
+	// Writes any queued frames and stops the writer thread
+	void close();
+
+	// Frame counts
+	int32_t getDroppedCount() const;
+	int32_t getFailedCount() const;
+	int32_t getQueuedCount() const;
+	bool isOpen() const;
+
+	// Creates the output folder and starts the writer thread
+	bool open(const ci::fs::path & directory, int32_t format);
+
+	// Queues a frame returned by ::acquire()
+	void write(Frame * frame);
+
+private:
+
+	// Writer thread loop
+	void decode(Frame & frame);
+	void run();
+	bool writeObj(const Frame & frame);
+	bool writePly(const Frame & frame);
+
+	// Properties
+	static const int32_t POOL_SIZE = 4;
+	std::condition_variable mCondition;
+	ci::fs::path mDirectory;
+	int32_t mDroppedCount;
+	int32_t mFailedCount;
+	int32_t mFormat;
+	uint32_t mFrameIndex;
+	std::vector<Frame *> mFree;
+	Frame mFrames[POOL_SIZE];
+	std::mutex mMutex;
+	bool mOpen;
+	std::deque<Frame *> mQueue;
+	int32_t mQueuedCount;
+	bool mRunning;
+	std::shared_ptr<std::thread> mThread;
+
+};
+
+// A pixel buffer in the export readback ring
+struct ReadbackSlot
+{
+	int32_t mBytes;
+	ci::Vec2f mDecode;
+	int32_t mHeight;
+	ci::gl::Vbo mPbo;
+	bool mPending;
+	GLenum mType;
+	int32_t mWidth;
+};
+
 // GPU mesh
 class MeshApp : public ci::app::AppBasic 
 {
@@ -63,6 +182,7 @@ private:
 	int32_t mMeshWidthPrev;
 
 	// Shader
+	void bindFragData(ci::gl::GlslProg & shader);
 	void loadShaders();
 	ci::gl::GlslProg mFboShader;
 	double mGlslVersion;
@@ -80,17 +200,128 @@ private:
 	ci::ColorAf mLightSpecular;
 
 	// FBO
-	GLenum mColorAttachment[1];
+	void drawFboQuad();
+	GLenum mColorAttachment[2];
 	bool mDrawFbo;
 	ci::gl::Fbo mFbo;
 	ci::gl::Fbo::Format mFboFormat;
-	ci::Surface32f mSurfacePosition;
+	ci::gl::Vbo mPbo;
 	ci::gl::Texture::Format mTextureFormat;
 	ci::gl::Texture	mTexturePosition;
+
+	// Position formats. The FBO uses the smallest format the GPU
+	// can render to which is precise enough for the grid. The 
+	// source texture only holds x and y. Normals are written to 
+	// the FBO's second attachment, in the same format.
+	void choosePositionFormat(int32_t size);
+	ci::Vec2f mNormalDecode;
+	ci::Vec2f mPositionDecode;
+	ci::gl::Fbo::Format mPositionFboFormat;
+	size_t mPositionFormat;
+	std::vector<PositionFormat> mPositionFormats;
+	int32_t mTextureChannels;
+	GLenum mTextureDataFormat;
+
+	// Weighted blended transparency. The mesh is drawn once 
+	// into a color target and a weight target, then the targets
+	// are resolved onto the screen. Nothing is sorted, and the
+	// result doesn't depend on draw order.
+	void drawMeshTransparent();
+	GLenum mOitAttachments[2];
+	bool mOitEnabled;
+	ci::gl::Fbo mOitFbo;
+	ci::gl::Fbo::Format mOitFormat;
+	ci::gl::GlslProg mResolveShader;
+
+	// Transform feedback. The wave pass writes displaced positions 
+	// straight into a vertex buffer, which is drawn as triangles
+	// with a static index buffer. Each position is computed once 
+	// and the mesh shaders never read a texture.
+	void bindFeedbackVaryings(ci::gl::GlslProg & shader);
+	bool isFeedbackActive() const;
+	void updateFeedback();
+	ci::gl::Vbo mFeedbackBuffer;
+	bool mFeedbackEnabled;
+	GLsizei mFeedbackIndexCount;
+	ci::gl::Vbo mFeedbackIndices;
+	ci::gl::GlslProg mFeedbackShader;
+	ci::gl::GlslProg mMeshShader;
+
+	// Triangle strips. Each pair of rows is one indexed strip,
+	// with a restart index between strips, so neighboring 
+	// triangles share transformed vertices.
+	static const int32_t BENCHMARK_FRAMES = 10;
+	static const uint32_t STRIP_RESTART_INDEX = 0xFFFFFFFF;
+	bool isStripActive() const;
+	void runStripBenchmark();
+	bool mStripEnabled;
+	GLsizei mStripIndexCount;
+	ci::gl::Vbo mStripIndices;
+	bool mStripRestart;
+	std::vector<GLsizei> mStripRowCounts;
+	std::vector<const GLvoid *> mStripRowOffsets;
+	ci::gl::GlslProg mStripShader;
+
+	// Simulation. Heights are stepped with the wave equation in a 
+	// ping-pong pair of FBOs, each step reading the state the last
+	// one wrote, so it carries from frame to frame. The wave pass 
+	// reads the heights in place of the sine wave.
+	static const int32_t SIM_BENCHMARK_STEPS = 100;
+	static const int32_t SIM_STEP_RATE = 120;
+	bool isSimActive() const;
+	void resetSimulation();
+	void runSimBenchmark();
+	void stepSimulation(int32_t steps, const ci::Vec4f & drop);
+	float mSimDamping;
+	float mSimDropRate;
+	float mSimDropTime;
+	bool mSimEnabled;
+	ci::gl::Fbo mSimFbo[2];
+	ci::gl::Fbo::Format mSimFormat;
+	int32_t mSimIndex;
+	ci::gl::GlslProg mSimShader;
+	float mSimSpeed;
+	float mSimStepTime;
+	int32_t mSimSubsteps;
+
+	// Wave pass. It only runs when one of its inputs changes,
+	// so paused or still frames skip a full resolution float
+	// render pass. The check compares its last output with the
+	// same wave on the CPU.
+	void checkWave();
+	float mWaveAmplitudePrev;
+	bool mWaveDirty;
+	bool mWaveFeedbackPrev;
+	bool mWavePaused;
+	float mWavePhasePrev;
+	float mWaveScalePrev;
+	bool mWaveShownPrev;
+	bool mWaveSimPrev;
+	float mWaveTime;
+	bool mWaveUpdated;
+	float mWaveWidthPrev;
+
+	// Export. Positions are read back through a ring of pixel
+	// buffers. Each buffer is mapped a full turn of the ring 
+	// after its read was issued, when the copy is long done, 
+	// so reading back never stalls the render thread.
+	static const int32_t READBACK_RING_SIZE = 3;
+	void exportFrame();
+	void readbackSlot(ReadbackSlot & slot);
+	void toggleExport();
+	int32_t mExportDropped;
+	MeshExporter mExporter;
+	int32_t mExportFormat;
+	int32_t mExportQueued;
+	int32_t mReadbackIndex;
+	ReadbackSlot mReadbackSlots[READBACK_RING_SIZE];
 	
 	// VBO
+	void drawMesh(bool transparent);
 	void initMesh();
-	std::vector<uint32_t> mVboIndices;
+	ci::Vec2i mCapacity;
+	std::vector<GLsizei> mVboCounts;
+	std::vector<GLint> mVboFirsts;
 	ci::gl::VboMesh::Layout mVboLayout;
 	std::vector<ci::Vec3f> mVboVertices;
 	std::vector<ci::Vec2f> mVboTexCoords;
@@ -116,6 +347,439 @@ using namespace ci;
 using namespace ci::app;
 using namespace std;
 
+// Constructor
+MeshExporter::MeshExporter()
+{
+	mDroppedCount = 0;
+	mFailedCount = 0;
+	mFormat = FORMAT_PLY;
+	mFrameIndex = 0;
+	mOpen = false;
+	mQueuedCount = 0;
+	mRunning = false;
+}
+
+// Destructor
+MeshExporter::~MeshExporter()
+{
+	close();
+}
+
+// Take a free frame from the pool
+MeshExporter::Frame * MeshExporter::acquire(int32_t width, int32_t height, int32_t bytes)
+{
+
+	// Bail if not open
+	if (!mOpen)
+		return 0;
+
+	// Every frame gets a number, so dropped frames
+	// leave a gap in the file names
+	uint32_t index = mFrameIndex++;
+	Frame * frame = 0;
+	{
+		lock_guard<mutex> lock(mMutex);
+		if (!mFree.empty())
+		{
+			frame = mFree.back();
+			mFree.pop_back();
+		}
+	}
+	if (frame == 0)
+	{
+		mDroppedCount++;
+		return 0;
+	}
+
+	// Size the frame for the mesh. Positions are
+	// sized by the writer when it decodes them.
+	frame->mData.resize((size_t)width * (size_t)height * (size_t)bytes);
+	frame->mHeight = height;
+	frame->mIndex = index;
+	frame->mWidth = width;
+	return frame;
+
+}
+
+// Stop the writer thread
+void MeshExporter::close()
+{
+
+	// Bail if not open
+	if (!mOpen)
+		return;
+
+	// Stop the writer. It writes what's left in the queue on its way out.
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mCondition.notify_one();
+	mThread->join();
+	mThread.reset();
+	mOpen = false;
+
+	// Release the pool
+	mFree.clear();
+	for (int32_t i = 0; i < POOL_SIZE; i++)
+	{
+		vector<uint8_t>().swap(mFrames[i].mData);
+		vector<float>().swap(mFrames[i].mPositions);
+	}
+
+}
+
+// Unpacks a frame's pixels into positions, undoing the 
+// FBO's encoding. Pixels are RGBA in the FBO's own type.
+void MeshExporter::decode(Frame & frame)
+{
+
+	// Bail if empty
+	size_t count = (size_t)frame.mWidth * (size_t)frame.mHeight;
+	frame.mPositions.resize(count * 3);
+	if (count == 0 || frame.mData.empty())
+		return;
+
+	// Read each point's x, y and z as a value 
+	// between zero and one, or as a float
+	float * output = & frame.mPositions[0];
+	if (frame.mType == GL_UNSIGNED_INT_2_10_10_10_REV)
+	{
+		const uint32_t * pixel = (const uint32_t *)& frame.mData[0];
+		for (size_t i = 0; i < count; i++, output += 3)
+		{
+			output[0] = (float)(pixel[i] & 0x3ff) / 1023.0f;
+			output[1] = (float)((pixel[i] >> 10) & 0x3ff) / 1023.0f;
+			output[2] = (float)((pixel[i] >> 20) & 0x3ff) / 1023.0f;
+		}
+	}
+	else if (frame.mType == GL_UNSIGNED_SHORT)
+	{
+		const uint16_t * pixel = (const uint16_t *)& frame.mData[0];
+		for (size_t i = 0; i < count; i++, output += 3, pixel += 4)
+		{
+			output[0] = (float)pixel[0] / 65535.0f;
+			output[1] = (float)pixel[1] / 65535.0f;
+			output[2] = (float)pixel[2] / 65535.0f;
+		}
+	}
+	else
+	{
+		const float * pixel = (const float *)& frame.mData[0];
+		for (size_t i = 0; i < count; i++, output += 3, pixel += 4)
+		{
+			output[0] = pixel[0];
+			output[1] = pixel[1];
+			output[2] = pixel[2];
+		}
+	}
+
+	// Scale back out to positions
+	for (size_t i = 0; i < frame.mPositions.size(); i++)
+		frame.mPositions[i] = frame.mPositions[i] * frame.mDecode.x + frame.mDecode.y;
+
+}
+
+// Frames dropped because the writer was behind
+int32_t MeshExporter::getDroppedCount() const
+{
+	return mDroppedCount;
+}
+
+// Frames which couldn't be written. Only read 
+// this once the exporter is closed.
+int32_t MeshExporter::getFailedCount() const
+{
+	return mFailedCount;
+}
+
+// Frames handed to the writer
+int32_t MeshExporter::getQueuedCount() const
+{
+	return mQueuedCount;
+}
+
+// Writer is running
+bool MeshExporter::isOpen() const
+{
+	return mOpen;
+}
+
+// Start a sequence
+bool MeshExporter::open(const fs::path & directory, int32_t format)
+{
+
+	// Close the last sequence
+	close();
+
+	// Create the folder
+	try
+	{
+		fs::create_directories(directory);
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	// Fill the pool and start the writer
+	mDirectory = directory;
+	mDroppedCount = 0;
+	mFailedCount = 0;
+	mFormat = format;
+	mFrameIndex = 0;
+	mFree.clear();
+	for (int32_t i = 0; i < POOL_SIZE; i++)
+		mFree.push_back(& mFrames[i]);
+	mQueue.clear();
+	mQueuedCount = 0;
+	mRunning = true;
+	mOpen = true;
+	mThread = shared_ptr<thread>(new thread(std::bind(& MeshExporter::run, this)));
+	return true;
+
+}
+
+// Writer thread. Frames go back to the pool as
+// soon as they're on disk.
+void MeshExporter::run()
+{
+
+	// Write until stopped and the queue is empty
+	while (true)
+	{
+
+		// Wait for a frame
+		Frame * frame = 0;
+		{
+			unique_lock<mutex> lock(mMutex);
+			while (mQueue.empty() && mRunning)
+				mCondition.wait(lock);
+			if (mQueue.empty())
+				return;
+			frame = mQueue.front();
+			mQueue.pop_front();
+		}
+
+		// Decode and write it out
+		decode(* frame);
+		bool written = mFormat == FORMAT_OBJ ? writeObj(* frame) : writePly(* frame);
+		if (!written)
+			mFailedCount++;
+
+		// Return it to the pool
+		{
+			lock_guard<mutex> lock(mMutex);
+			mFree.push_back(frame);
+		}
+
+	}
+
+}
+
+// Queue a frame
+void MeshExporter::write(Frame * frame)
+{
+	if (!mOpen || frame == 0)
+		return;
+	{
+		lock_guard<mutex> lock(mMutex);
+		mQueue.push_back(frame);
+	}
+	mQueuedCount++;
+	mCondition.notify_one();
+}
+
+// Writes a frame as a text OBJ file with one quad per grid cell
+bool MeshExporter::writeObj(const Frame & frame)
+{
+
+	// Create the file
+	ostringstream name;
+	name << "frame_" << setfill('0') << setw(6) << frame.mIndex << ".obj";
+	FILE * file = fopen((mDirectory / name.str()).string().c_str(), "w");
+	if (file == 0)
+		return false;
+
+	// Write vertices
+	const float * position = frame.mPositions.empty() ? 0 : & frame.mPositions[0];
+	for (int32_t i = 0; i < frame.mWidth * frame.mHeight; i++, position += 3)
+		fprintf(file, "v %f %f %f\n", position[0], position[1], position[2]);
+
+	// Write faces. OBJ indices start at one.
+	for (int32_t y = 0; y < frame.mHeight - 1; y++)
+		for (int32_t x = 0; x < frame.mWidth - 1; x++)
+		{
+			int32_t index = y * frame.mWidth + x + 1;
+			fprintf(file, "f %d %d %d %d\n", index, index + frame.mWidth, index + frame.mWidth + 1, index + 1);
+		}
+
+	// Close the file
+	fclose(file);
+	return true;
+
+}
+
+// Writes a frame as a binary PLY file with one quad per grid cell
+bool MeshExporter::writePly(const Frame & frame)
+{
+
+	// Create the file
+	ostringstream name;
+	name << "frame_" << setfill('0') << setw(6) << frame.mIndex << ".ply";
+	FILE * file = fopen((mDirectory / name.str()).string().c_str(), "wb");
+	if (file == 0)
+		return false;
+
+	// Write the header
+	int32_t faceCount = math<int32_t>::max(frame.mWidth - 1, 0) * math<int32_t>::max(frame.mHeight - 1, 0);
+	fprintf(file, "ply\nformat binary_little_endian 1.0\n");
+	fprintf(file, "element vertex %d\nproperty float x\nproperty float y\nproperty float z\n", frame.mWidth * frame.mHeight);
+	fprintf(file, "element face %d\nproperty list uchar int vertex_indices\nend_header\n", faceCount);
+
+	// Positions are already packed as three floats
+	if (!frame.mPositions.empty())
+		fwrite(& frame.mPositions[0], sizeof(float), frame.mPositions.size(), file);
+
+	// Write faces a row at a time. Each is a count 
+	// followed by four indices.
+	static const size_t FACE_BYTES = sizeof(uint8_t) + 4 * sizeof(int32_t);
+	vector<uint8_t> row(math<int32_t>::max(frame.mWidth - 1, 1) * FACE_BYTES);
+	for (int32_t y = 0; y < frame.mHeight - 1; y++)
+	{
+		uint8_t * face = & row[0];
+		for (int32_t x = 0; x < frame.mWidth - 1; x++, face += FACE_BYTES)
+		{
+			int32_t index = y * frame.mWidth + x;
+			int32_t indices[4] = { index, index + frame.mWidth, index + frame.mWidth + 1, index + 1 };
+			face[0] = 4;
+			memcpy(face + 1, indices, sizeof(indices));
+		}
+		fwrite(& row[0], FACE_BYTES, frame.mWidth - 1, file);
+	}
+
+	// Close the file
+	fclose(file);
+	return true;
+
+}
+
+// Captured outputs must be named before the program is 
+// linked, so we name them and link again. All three are 
+// written into one buffer, one vertex after another.
+void MeshApp::bindFeedbackVaryings(gl::GlslProg & shader)
+{
+	const char * varyings[3] = { "position", "uv", "normal" };
+	glTransformFeedbackVaryingsEXT(shader.getHandle(), 3, varyings, GL_INTERLEAVED_ATTRIBS_EXT);
+	glLinkProgram(shader.getHandle());
+}
+
+// GLSL 1.5 shaders write to a second output when drawing
+// transparency. Outputs must be numbered before the program
+// is linked, so we number them and link again.
+void MeshApp::bindFragData(gl::GlslProg & shader)
+{
+	glBindFragDataLocationEXT(shader.getHandle(), 0, "color");
+	glBindFragDataLocationEXT(shader.getHandle(), 1, "weight");
+	glLinkProgram(shader.getHandle());
+}
+
+// Reads the FBO's positions back and compares them with the
+// wave computed on the CPU from the same inputs
+void MeshApp::checkWave()
+{
+
+	// The FBO only holds the sine wave when the simulation is
+	// off, and is skipped while feedback is on and it's hidden
+	if (!mFbo || mWaveSimPrev || (mWaveFeedbackPrev && !mWaveShownPrev))
+	{
+		trace("Wave check needs the sine wave in the FBO. Turn off the simulation, or show the FBO.");
+		return;
+	}
+
+	// Read the positions in use. This waits on the GPU, 
+	// which is fine for a one off check.
+	size_t count = (size_t)mMeshWidth * (size_t)mMeshHeight;
+	vector<float> pixels(count * 3);
+	mFbo.bindFramebuffer();
+	glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+	glReadPixels(0, 0, mMeshWidth, mMeshHeight, GL_RGB, GL_FLOAT, & pixels[0]);
+	mFbo.unbindFramebuffer();
+
+	// Run the wave the last pass ran. The shader only 
+	// sees phase times speed, so that's the phase.
+	vector<float> x(count);
+	vector<float> y(count);
+	vector<float> z(count);
+	WaveField::fillGrid(mMeshWidth, mMeshHeight, & x[0], & y[0], & z[0], 2.0f);
+	WaveField waveField;
+	waveField.setWave(mWaveAmplitudePrev, mWavePhasePrev, mWaveScalePrev, 1.0f, mWaveWidthPrev);
+	Timer timer(true);
+	waveField.displace(& x[0], & y[0], & z[0], & x[0], & y[0], & z[0], count);
+	double seconds = timer.getSeconds();
+
+	// Compare, undoing the FBO's encoding
+	float error = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		const float * pixel = & pixels[i * 3];
+		error = math<float>::max(error, math<float>::abs(pixel[0] * mPositionDecode.x + mPositionDecode.y - x[i]));
+		error = math<float>::max(error, math<float>::abs(pixel[1] * mPositionDecode.x + mPositionDecode.y - y[i]));
+		error = math<float>::max(error, math<float>::abs(pixel[2] * mPositionDecode.x + mPositionDecode.y - z[i]));
+	}
+
+	// Report
+	trace("Wave check: " + toString(mMeshWidth) + "x" + toString(mMeshHeight) + ", CPU " + 
+		toString(seconds * 1000.0) + "ms, max error " + toString(error));
+
+}
+
+// Picks the smallest position format the FBO can render to 
+// which is precise enough for a grid of this size. The last
+// format is used if nothing else works.
+void MeshApp::choosePositionFormat(int32_t size)
+{
+	for (size_t i = 0; i < mPositionFormats.size(); i++)
+	{
+
+		// Skip formats which are too coarse
+		PositionFormat & format = mPositionFormats[i];
+		bool last = i + 1 == mPositionFormats.size();
+		if (size > format.mMaxSize && !last)
+			continue;
+
+		// Test each format once with a small FBO
+		if (!format.mTested)
+		{
+			gl::Fbo::Format fboFormat = mFboFormat;
+			fboFormat.setColorInternalFormat(format.mInternalFormat);
+			glGetError();
+			try
+			{
+				gl::Fbo fbo(64, 64, fboFormat);
+				format.mRenderable = glGetError() == GL_NO_ERROR;
+			}
+			catch (...)
+			{
+				format.mRenderable = false;
+			}
+			format.mTested = true;
+		}
+
+		// Use the first format that works
+		if (format.mRenderable || last)
+		{
+			if (i != mPositionFormat)
+				trace("Position format: " + format.mName + ", " + toString(format.mBytes) + " bytes per point");
+			mPositionFboFormat = mFboFormat;
+			mPositionFboFormat.setColorInternalFormat(format.mInternalFormat);
+			mPositionFormat = i;
+			return;
+		}
+
+	}
+}
+
 // Renders the scene
 void MeshApp::draw()
 {
@@ -130,19 +794,68 @@ void MeshApp::draw()
 	{
 		gl::setMatricesWindow(getWindowSize(), true);
 		mFbo.getTexture().enableAndBind();
-		gl::draw(mFbo.getTexture(), Area(getWindowSize().x / 4, getWindowSize().y / 4, 3 * (getWindowSize().x / 4), 3 * (getWindowSize().y / 4)));
+		gl::draw(mFbo.getTexture(), Area(0, 0, mMeshWidth, mMeshHeight), Area(getWindowSize().x / 4, getWindowSize().y / 4, 3 * (getWindowSize().x / 4), 3 * (getWindowSize().y / 4)));
 		mFbo.getTexture().unbind();
 	}
 
 	// Set matrices to camera view
 	gl::setMatrices(mCamera);
 
+	// Draw the mesh
+	if (mOitEnabled && mOitFbo && mResolveShader)
+		drawMeshTransparent();
+	else
+		drawMesh(false);
+
+	// Read back positions while recording
+	if (mExporter.isOpen())
+		exportFrame();
+
+	// Draw the params interface
+	params::InterfaceGl::draw();
+
+}
+
+// Draws a quad over the part of the FBO in use. Texture 
+// coordinates cover the same texels in the position texture.
+void MeshApp::drawFboQuad()
+{
+	float u = (float)mMeshWidth / (float)mCapacity.x;
+	float v = (float)mMeshHeight / (float)mCapacity.y;
+	glBegin(GL_QUADS);
+	{
+		glTexCoord2f(0.0f, 0.0f);
+		gl::vertex(0.0f, 0.0f);
+		glTexCoord2f(0.0f, v);
+		gl::vertex(0.0f, (float)mMeshHeight);
+		glTexCoord2f(u, v);
+		gl::vertex((float)mMeshWidth, (float)mMeshHeight);
+		glTexCoord2f(u, 0.0f);
+		gl::vertex((float)mMeshWidth, 0.0f);
+	}
+	glEnd();
+}
+
+// Draws the mesh from the FBO's positions, or from the
+// feedback buffer when transform feedback is on
+void MeshApp::drawMesh(bool transparent)
+{
+
+	// Choose shader
+	bool feedback = isFeedbackActive();
+	bool strip = isStripActive();
+	gl::GlslProg & shader = feedback ? mMeshShader : (strip ? mStripShader : mVboShader);
+
 	// Take the FBO to which we rendered in ::update()
-	// and bind its color attachment as a texture
-	mFbo.bindTexture(0, 0);
+	// and bind its positions and normals as textures
+	if (!feedback)
+	{
+		mFbo.bindTexture(0, 0);
+		mFbo.bindTexture(1, 1);
+	}
 
 	// Bind the shader to render the VBO
-	mVboShader.bind();
+	shader.bind();
 	
 	// Move into position
 	gl::pushModelView();
@@ -150,29 +863,178 @@ void MeshApp::draw()
 	gl::rotate(mMeshRotation);
 
 	// Set shader uniforms
-	mVboShader.uniform("alpha", mMeshAlpha);
-	mVboShader.uniform("eyePoint", mEyePoint);
-	mVboShader.uniform("lightAmbient", mLightAmbient);
-	mVboShader.uniform("lightDiffuse", mLightDiffuse);
-	mVboShader.uniform("lightPosition", mLightPosition);
-	mVboShader.uniform("lightSpecular", mLightSpecular);
-	mVboShader.uniform("mvp", gl::getProjection() * gl::getModelView());
-	mVboShader.uniform("pixel", Vec2f(1.0f / (float)mMeshWidth, 1.0f / (float)mMeshHeight));
-	mVboShader.uniform("positions", 0);
-	mVboShader.uniform("shininess", mLightShininess);
-	mVboShader.uniform("transform", mTransform);
-	mVboShader.uniform("uvmix", mMeshUvMix);
+	shader.uniform("alpha", mMeshAlpha);
+	shader.uniform("extent", Vec2f((float)(mMeshWidth - 1) / (float)mCapacity.x, (float)(mMeshHeight - 1) / (float)mCapacity.y));
+	shader.uniform("eyePoint", mEyePoint);
+	shader.uniform("lightAmbient", mLightAmbient);
+	shader.uniform("lightDiffuse", mLightDiffuse);
+	shader.uniform("lightPosition", mLightPosition);
+	shader.uniform("lightSpecular", mLightSpecular);
+	shader.uniform("mvp", gl::getProjection() * gl::getModelView());
+	shader.uniform("normalDecode", mNormalDecode);
+	shader.uniform("normals", 1);
+	shader.uniform("oit", transparent);
+	shader.uniform("oitDepth", math<float>::max(mEyePoint.distance(mMeshOffset), 1.0f));
+	shader.uniform("pixel", Vec2f(1.0f / (float)mCapacity.x, 1.0f / (float)mCapacity.y));
+	shader.uniform("positionDecode", mPositionDecode);
+	shader.uniform("positions", 0);
+	shader.uniform("shininess", mLightShininess);
+	shader.uniform("transform", mTransform);
+	shader.uniform("uvmix", mMeshUvMix);
 	
-	// Draw VBO
-	gl::draw(mVboMesh);
+	if (feedback)
+	{
+
+		// Draw triangles from the feedback buffer. Each vertex
+		// is a position, a texture coordinate, and a normal.
+		mFeedbackBuffer.bind();
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glVertexPointer(4, GL_FLOAT, 12 * sizeof(float), 0);
+		glTexCoordPointer(4, GL_FLOAT, 12 * sizeof(float), (const GLvoid *)(4 * sizeof(float)));
+		glNormalPointer(GL_FLOAT, 12 * sizeof(float), (const GLvoid *)(8 * sizeof(float)));
+		mFeedbackIndices.bind();
+		glDrawElements(GL_TRIANGLES, mFeedbackIndexCount, GL_UNSIGNED_INT, 0);
+		mFeedbackIndices.unbind();
+		glDisableClientState(GL_NORMAL_ARRAY);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glDisableClientState(GL_VERTEX_ARRAY);
+		mFeedbackBuffer.unbind();
+
+	}
+	else if (strip)
+	{
+
+		// Draw strips through the points. Without primitive 
+		// restart, each strip is its own range of the indices.
+		mVboMesh.enableClientStates();
+		mVboMesh.bindAllData();
+		mStripIndices.bind();
+		if (mStripRestart)
+		{
+			glEnable(GL_PRIMITIVE_RESTART_NV);
+			glPrimitiveRestartIndexNV(STRIP_RESTART_INDEX);
+			glDrawElements(GL_TRIANGLE_STRIP, mStripIndexCount, GL_UNSIGNED_INT, 0);
+			glDisable(GL_PRIMITIVE_RESTART_NV);
+		}
+		else if (!mStripRowCounts.empty())
+		{
+			glMultiDrawElements(GL_TRIANGLE_STRIP, &mStripRowCounts[0], GL_UNSIGNED_INT, &mStripRowOffsets[0], (GLsizei)mStripRowCounts.size());
+		}
+		mStripIndices.unbind();
+		mVboMesh.unbindBuffers();
+		mVboMesh.disableClientStates();
+
+	}
+	else
+	{
+
+		// Draw the rows of the VBO in use
+		mVboMesh.enableClientStates();
+		mVboMesh.bindAllData();
+		glMultiDrawArrays(GL_POINTS, &mVboFirsts[0], &mVboCounts[0], (GLsizei)mVboFirsts.size());
+		mVboMesh.unbindBuffers();
+		mVboMesh.disableClientStates();
+
+	}
 
 	// Stop drawing
 	gl::popModelView();
-	mVboShader.unbind();
-	mFbo.unbindTexture();
+	shader.unbind();
+	if (!feedback)
+	{
+		mFbo.getTexture(1).unbind(1);
+		mFbo.unbindTexture();
+	}
 
-	// Draw the params interface
-	params::InterfaceGl::draw();
+}
+
+// Draws the mesh with weighted blended transparency
+void MeshApp::drawMeshTransparent()
+{
+
+	// Clear the color target to a revealage of one and 
+	// the weight target to zero
+	mOitFbo.bindFramebuffer();
+	glDrawBuffer(mOitAttachments[0]);
+	gl::clear(ColorAf(0.0f, 0.0f, 0.0f, 1.0f), false);
+	glDrawBuffer(mOitAttachments[1]);
+	gl::clear(ColorAf::zero(), false);
+	glDrawBuffers(2, mOitAttachments);
+
+	// Draw every layer. Depth testing would throw away the 
+	// layers behind, so turn it off. Color and weight add 
+	// up while the color target's alpha is multiplied by 
+	// (1 - alpha) for each layer.
+	glDisable(GL_DEPTH_TEST);
+	glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+	drawMesh(true);
+	mOitFbo.unbindFramebuffer();
+
+	// Resolve onto the screen with a window-sized quad
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl::pushMatrices();
+	gl::setMatricesWindow(getWindowSize());
+	mOitFbo.bindTexture(0, 0);
+	mOitFbo.bindTexture(1, 1);
+	mResolveShader.bind();
+	mResolveShader.uniform("colors", 0);
+	mResolveShader.uniform("pixel", Vec2f(1.0f / (float)getWindowWidth(), 1.0f / (float)getWindowHeight()));
+	mResolveShader.uniform("weights", 1);
+	gl::drawSolidRect(Rectf(getWindowBounds()));
+	mResolveShader.unbind();
+	mOitFbo.getTexture(1).unbind(1);
+	mOitFbo.getTexture(0).unbind(0);
+	gl::popMatrices();
+	glEnable(GL_DEPTH_TEST);
+
+}
+
+// Reads this frame's positions back into the ring, and hands
+// the oldest read in the ring to the exporter
+void MeshApp::exportFrame()
+{
+
+	// The slot we're about to reuse was read a full turn
+	// ago, so mapping it won't wait on the GPU
+	ReadbackSlot & slot = mReadbackSlots[mReadbackIndex];
+	if (slot.mPending)
+		readbackSlot(slot);
+
+	// Size the slot's buffer for the mesh. Pixels are read
+	// as RGBA in the FBO's own type, so the driver copies 
+	// them without converting.
+	const PositionFormat & format = mPositionFormats[mPositionFormat];
+	if (!slot.mPbo)
+		slot.mPbo = gl::Vbo(GL_PIXEL_PACK_BUFFER_ARB);
+	slot.mPbo.bind();
+	if (slot.mWidth != mMeshWidth || slot.mHeight != mMeshHeight || slot.mBytes != format.mBytes)
+	{
+		slot.mPbo.bufferData(mMeshWidth * mMeshHeight * format.mBytes, 0, GL_STREAM_READ);
+		slot.mBytes = format.mBytes;
+		slot.mHeight = mMeshHeight;
+		slot.mWidth = mMeshWidth;
+	}
+
+	// Start copying the part of the FBO in use into the 
+	// buffer. The data pointer is an offset into the 
+	// bound buffer, so this returns right away.
+	mFbo.bindFramebuffer();
+	glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+	glReadPixels(0, 0, mMeshWidth, mMeshHeight, GL_RGBA, format.mType, 0);
+	mFbo.unbindFramebuffer();
+	slot.mPbo.unbind();
+	slot.mDecode = mPositionDecode;
+	slot.mPending = true;
+	slot.mType = format.mType;
+
+	// Move around the ring
+	mReadbackIndex = (mReadbackIndex + 1) % READBACK_RING_SIZE;
+
+	// Update counts for the params
+	mExportDropped = mExporter.getDroppedCount();
+	mExportQueued = mExporter.getQueuedCount();
 
 }
 
@@ -181,128 +1043,253 @@ void MeshApp::draw()
 // basically just a grid of evenly spaced vertices (points). By
 // using a FBO for the source, the shaders will be able to see the
 // values of each point's neighbor so we can form a solid mesh.
+//
+// The texture, FBO, and VBO are allocated at a power-of-two 
+// capacity and only the corner the mesh needs is used, so 
+// resizing within the capacity doesn't reallocate anything.
 void MeshApp::initMesh()
 {
 
+	// Time the rebuild
+	Timer timer(true);
+
 	/* STEP 1
 	 * 
-	 * Create a surface and set the color data for each pixel.
-	 * The surfaces will hold XYZ coordinates in the RGB values.
+	 * Grow the GPU storage if the mesh no longer fits. It 
+	 * never shrinks, so dragging a slider back and forth
+	 * doesn't create anything new.
 	 */
 
-	// Clear surfaces if they already exist
-	if (mSurfacePosition)
-		mSurfacePosition.reset();
+	// Find capacity
+	Vec2i capacity = mCapacity;
+	while (capacity.x < mMeshWidth)
+		capacity.x = math<int32_t>::max(capacity.x * 2, 64);
+	while (capacity.y < mMeshHeight)
+		capacity.y = math<int32_t>::max(capacity.y * 2, 64);
+	if (capacity != mCapacity)
+	{
+
+		// Create position texture
+		mTexturePosition = gl::Texture(capacity.x, capacity.y, mTextureFormat);
+		mTexturePosition.setWrap(GL_REPEAT, GL_REPEAT);
+		mTexturePosition.setMinFilter(GL_NEAREST);
+		mTexturePosition.setMagFilter(GL_NEAREST);
+
+		// Create the FBO. The wave pass in ::update() fills it,
+		// so we only need to clear it here.
+		choosePositionFormat(math<int32_t>::max(capacity.x, capacity.y));
+		mFbo = gl::Fbo(capacity.x, capacity.y, mPositionFboFormat);
+		mFbo.bindFramebuffer();
+		glDrawBuffers(2, mColorAttachment);
+		gl::clear(ColorAf::black(), true);
+		mFbo.unbindFramebuffer();
+
+		// The simulation's FBOs are the same size
+		if (mSimShader)
+		{
+			mSimFbo[0] = gl::Fbo(capacity.x, capacity.y, mSimFormat);
+			mSimFbo[1] = gl::Fbo(capacity.x, capacity.y, mSimFormat);
+		}
 
-	// Create empty surfaces to hold position data
-	mSurfacePosition = Surface32f(mMeshWidth, mMeshHeight, true, SurfaceChannelOrder::RGBA);
+		// Create a point for every texel. Texture coordinates
+		// point at the texel, so the shaders read their position
+		// from the FBO. We only draw the rows in use.
+		mVboTexCoords.reserve(capacity.x * capacity.y);
+		mVboVertices.reserve(capacity.x * capacity.y);
+		for (int32_t y = 0; y < capacity.y; y++)
+			for (int32_t x = 0; x < capacity.x; x++)
+			{
+				mVboTexCoords.push_back(Vec2f((float)x / (float)capacity.x, (float)y / (float)capacity.y));
+				mVboVertices.push_back(Vec3f((float)x, (float)y, 0.0f));
+			}
+		mVboMesh = gl::VboMesh(mVboVertices.size(), 0, mVboLayout, GL_POINTS);
+		mVboMesh.bufferPositions(mVboVertices);
+		mVboMesh.bufferTexCoords2d(0, mVboTexCoords);
+
+		// WORKAROUND: The bufferPositions call does not
+		// unbind the VBO
+		mVboMesh.unbindBuffers();
+
+		// Make room for a position, texture coordinate, and
+		// normal per point in the feedback buffer
+		if (!mFeedbackBuffer)
+			mFeedbackBuffer = gl::Vbo(GL_ARRAY_BUFFER);
+		mFeedbackBuffer.bind();
+		mFeedbackBuffer.bufferData(capacity.x * capacity.y * 12 * sizeof(float), 0, GL_STREAM_COPY);
+		mFeedbackBuffer.unbind();
+
+		// Clean up
+		mVboTexCoords.clear();
+		mVboVertices.clear();
+		mCapacity = capacity;
 
-	// Iterate through the position surface's pixels.
-	// Convert the position to world space and set the 
-	// position data in the color of each pixel.
-	Surface32f::Iter pixelIt = mSurfacePosition.getIter();
-	while (pixelIt.line())
-		while (pixelIt.pixel())
-			mSurfacePosition.setPixel(pixelIt.getPos(), ColorAf(
-				(float)pixelIt.x() * 2.0f - (float)mMeshWidth, 
-				(float)pixelIt.y() * 2.0f - (float)mMeshHeight, 
-				0.0f, 1.0f));
+	}
 
 	/* STEP 2
 	 * 
-	 * With the surface data populated, we will now create a texture.
-	 * The difference between a surface and texture is that a 
-	 * surface is computed by the CPU. A texture is uploaded to the 
-	 * GPU and is processed or displayed there, which is much faster.
+	 * Write XYZ positions straight into a pixel buffer object,
+	 * then copy it to the position texture. The copy is done by
+	 * the driver, so we don't wait for it here.
 	 */
 
-	// Clear texture if it already exists
-	if (mTexturePosition)
-		mTexturePosition.reset();
+	// Discard the buffer's old contents so mapping it doesn't 
+	// wait for the last upload to finish
+	if (!mPbo)
+		mPbo = gl::Vbo(GL_PIXEL_UNPACK_BUFFER_ARB);
+	mPbo.bind();
+	mPbo.bufferData(mMeshWidth * mMeshHeight * mTextureChannels * sizeof(float), 0, GL_STREAM_DRAW);
 
-	// Create position texture
-	mTexturePosition = gl::Texture(mSurfacePosition, mTextureFormat);
-	mTexturePosition.setWrap(GL_REPEAT, GL_REPEAT);
-	mTexturePosition.setMinFilter(GL_NEAREST);
-	mTexturePosition.setMagFilter(GL_NEAREST);
+	// Write each texel's position, row by row
+	float * position = (float *)mPbo.map(GL_WRITE_ONLY);
+	if (position != 0)
+	{
+		for (int32_t y = 0; y < mMeshHeight; y++)
+		{
+			float positionY = (float)y * 2.0f - (float)mMeshHeight;
+			for (int32_t x = 0; x < mMeshWidth; x++)
+			{
+				position[0] = (float)x * 2.0f - (float)mMeshWidth;
+				position[1] = positionY;
+				if (mTextureChannels > 2)
+				{
+					position[2] = 0.0f;
+					position[3] = 1.0f;
+				}
+				position += mTextureChannels;
+			}
+		}
+		mPbo.unmap();
+
+		// Copy into the corner of the texture in use. The 
+		// data pointer is an offset into the bound buffer.
+		mTexturePosition.bind();
+		glTexSubImage2D(mTexturePosition.getTarget(), 0, 0, 0, mMeshWidth, mMeshHeight, mTextureDataFormat, GL_FLOAT, 0);
+		mTexturePosition.unbind();
+
+	}
+	mPbo.unbind();
 
 	/* STEP 3
 	 * 
-	 * Now we're going to create the frame buffer object. The idea
-	 * is to send the position texture to the GPU, then draw it onto 
-	 * the FBO using a shader to manipulate the color data.
+	 * Points are laid out at the capacity width, so each row 
+	 * in use is a separate range. All rows are drawn with
+	 * one call.
 	 */
 
-	// Clear current FBO, if needed
-	if (mFbo)
-		mFbo.reset();
-
-	// Initialize FBO
-	mFbo = gl::Fbo(mMeshWidth, mMeshHeight, mFboFormat);
-
-	// Bind the FBO so we can draw onto it
-	mFbo.bindFramebuffer();
-	
-	// The FBO has a color attachment buffer. We use this instead
-	// of the standard buffer because we can use a larger range 
-	// of values.
-	glDrawBuffer(mColorAttachment[0]);
-
-	// Set up the render target
-	gl::clear(ColorAf::black(), true);
-	gl::setViewport(mFbo.getBounds());
-	gl::setMatricesWindow(mFbo.getSize(), false);
-
-	// Draw the position texture into the FBO's color attachment
-	mTexturePosition.enableAndBind();
-	gl::draw(mTexturePosition, mFbo.getBounds());
-	mTexturePosition.unbind();
-
-	// Unbind the FBO to change our render target to the screen
-	mFbo.unbindFramebuffer();
+	// Set ranges
+	mVboCounts.assign(mMeshHeight, mMeshWidth);
+	mVboFirsts.resize(mMeshHeight);
+	for (int32_t y = 0; y < mMeshHeight; y++)
+		mVboFirsts[y] = y * mCapacity.x;
 
 	/* STEP 4
 	 * 
-	 * The final step in creating our mesh is to make a vertex
-	 * buffer object. This holds the actual 3D data that we will 
-	 * render to the screen.
+	 * Feedback writes points into its buffer in the order
+	 * they're drawn, so they're packed at the mesh width.
+	 * Index two triangles per quad, wound the same as the
+	 * point shader's.
 	 */
 
-	// Clear the VBO if it already exists
-	if (mVboMesh)
-		mVboMesh.reset();
+	// Create index buffer
+	if (!mFeedbackIndices)
+		mFeedbackIndices = gl::Vbo(GL_ELEMENT_ARRAY_BUFFER);
+	mFeedbackIndexCount = (mMeshWidth - 1) * (mMeshHeight - 1) * 6;
+	mFeedbackIndices.bind();
+	mFeedbackIndices.bufferData(mFeedbackIndexCount * sizeof(uint32_t), 0, GL_STATIC_DRAW);
+	uint32_t * index = (uint32_t *)mFeedbackIndices.map(GL_WRITE_ONLY);
+	if (index != 0)
+	{
+		for (int32_t y = 0; y < mMeshHeight - 1; y++)
+			for (int32_t x = 0; x < mMeshWidth - 1; x++)
+			{
+
+				// Corners of the quad
+				uint32_t index0 = (uint32_t)(x + y * mMeshWidth);
+				uint32_t index1 = index0 + 1;
+				uint32_t index2 = index1 + (uint32_t)mMeshWidth;
+				uint32_t index3 = index0 + (uint32_t)mMeshWidth;
+
+				// Left triangle
+				index[0] = index0;
+				index[1] = index3;
+				index[2] = index1;
+
+				// Right triangle
+				index[3] = index1;
+				index[4] = index3;
+				index[5] = index2;
+				index += 6;
+
+			}
+		mFeedbackIndices.unmap();
+	}
+	else
+	{
+		mFeedbackIndexCount = 0;
+	}
+	mFeedbackIndices.unbind();
 
-	// Iterate through the mesh dimensions
-	for (int32_t y = 0; y < mMeshHeight; y++)
-		for (int32_t x = 0; x < mMeshWidth; x++)
+	/* STEP 5
+	 * 
+	 * Strips are drawn through the points, which are laid out 
+	 * at the capacity width. Each pair of rows is one strip,
+	 * zig-zagging down and across so its triangles are wound
+	 * the same as the point shader's. The strips are separated
+	 * by a restart index.
+	 */
+
+	// Create index buffer
+	int32_t stripCount = math<int32_t>::max(mMeshHeight - 1, 0);
+	int32_t stripLength = mMeshWidth > 1 ? mMeshWidth * 2 : 0;
+	mStripIndexCount = stripCount > 0 ? stripCount * stripLength + stripCount - 1 : 0;
+	if (!mStripIndices)
+		mStripIndices = gl::Vbo(GL_ELEMENT_ARRAY_BUFFER);
+	mStripIndices.bind();
+	mStripIndices.bufferData(mStripIndexCount * sizeof(uint32_t), 0, GL_STATIC_DRAW);
+	index = (uint32_t *)mStripIndices.map(GL_WRITE_ONLY);
+	mStripRowCounts.clear();
+	mStripRowOffsets.clear();
+	if (index != 0 && stripLength > 0)
+	{
+		uint32_t * first = index;
+		for (int32_t y = 0; y < stripCount; y++)
 		{
 
-			// Set the index of the vertex in the VBO so it is
-			// numbered left to right, top to bottom
-			mVboIndices.push_back(x + y * mMeshWidth);
+			// Separate from the previous strip
+			if (y > 0)
+				*index++ = STRIP_RESTART_INDEX;
 
-			// Set the position of the vertex in world space
-			mVboVertices.push_back(Vec3f((float)x - (float)mMeshWidth * 0.5f, (float)y - (float)mMeshHeight * 0.5f, 0.0f));
+			// Remember where the strip is for drawing 
+			// without primitive restart
+			mStripRowCounts.push_back(stripLength);
+			mStripRowOffsets.push_back((const GLvoid *)((index - first) * sizeof(uint32_t)));
 
-			// Use percentage of the position for the texture coordinate
-			mVboTexCoords.push_back(Vec2f((float)x / (float)mMeshWidth, (float)y / (float)mMeshHeight));
+			// Add the strip
+			for (int32_t x = 0; x < mMeshWidth; x++)
+			{
+				*index++ = (uint32_t)(x + y * mCapacity.x);
+				*index++ = (uint32_t)(x + (y + 1) * mCapacity.x);
+			}
 
 		}
-	
-	// Create VBO
-	mVboMesh = gl::VboMesh(mVboIndices.size(), mVboIndices.size(), mVboLayout, GL_POINTS);
-	mVboMesh.bufferIndices(mVboIndices);
-	mVboMesh.bufferPositions(mVboVertices);
-	mVboMesh.bufferTexCoords2d(0, mVboTexCoords);
-
-	// WORKAROUND: The bufferPositions call does not
-	// unbind the VBO
-	mVboMesh.unbindBuffers();
+		mStripIndices.unmap();
+	}
+	else
+	{
+		if (index != 0)
+			mStripIndices.unmap();
+		mStripIndexCount = 0;
+	}
+	mStripIndices.unbind();
 
-	// Clean up
-	mVboIndices.clear();
-	mVboTexCoords.clear();
-	mVboVertices.clear();
+	// The source texture changed, so the wave pass 
+	// has to run again. The simulation starts over 
+	// on the new grid.
+	mWaveDirty = true;
+	resetSimulation();
+
+	// Report
+	trace("Mesh " + toString(mMeshWidth) + "x" + toString(mMeshHeight) + " built in " + toString(timer.getSeconds() * 1000.0) + "ms");
 
 	// Call the resize event to reset the camera 
 	// and OpenGL state
@@ -310,6 +1297,26 @@ void MeshApp::initMesh()
 
 }
 
+// Feedback replaces the points only when they're drawn as 
+// triangles. The pass-thru shader still reads the FBO.
+bool MeshApp::isFeedbackActive() const
+{
+	return mFeedbackEnabled && mTransform && !isSimActive() && mFeedbackShader && mMeshShader;
+}
+
+// The simulation needs its shader and FBOs
+bool MeshApp::isSimActive() const
+{
+	return mSimEnabled && mSimShader && mSimFbo[0] && mSimFbo[1];
+}
+
+// Strips replace the points only when they're drawn as 
+// triangles, and not when transform feedback is on
+bool MeshApp::isStripActive() const
+{
+	return mStripEnabled && mTransform && !isFeedbackActive() && mStripShader;
+}
+
 // Load GLSL shaders from resources
 void MeshApp::loadShaders()
 {
@@ -354,6 +1361,8 @@ void MeshApp::loadShaders()
 				loadResource(RES_SHADER_VBO_GEOM_150), 
 				GL_POINTS, GL_TRIANGLE_STRIP, maxGeomOutputVertices
 				);
+			bindFragData(mVboShaderPassThru);
+			bindFragData(mVboShaderTransform);
 
 			// Load the FBO shader
 			mFboShader = gl::GlslProg(
@@ -410,6 +1419,105 @@ void MeshApp::loadShaders()
 	// Use transform shader by default
 	mVboShader = mVboShaderTransform;
 
+	// Load the transparency resolve shader separately. The 
+	// app runs without it if it doesn't compile.
+	try
+	{
+		if (mGlslVersion >= 1.5)
+			mResolveShader = gl::GlslProg(loadResource(RES_SHADER_RESOLVE_VERT_150), loadResource(RES_SHADER_RESOLVE_FRAG_150));
+		else
+			mResolveShader = gl::GlslProg(loadResource(RES_SHADER_RESOLVE_VERT_120), loadResource(RES_SHADER_RESOLVE_FRAG_120));
+	}
+	catch (gl::GlslProgCompileExc & ex)
+	{
+		trace("Order independent transparency not available.");
+		trace(ex.what());
+	}
+	catch (...)
+	{
+		trace("Order independent transparency not available.");
+	}
+
+	// Load the transform feedback shaders. These are optional, too.
+	try
+	{
+		if (!gl::isExtensionAvailable("GL_EXT_transform_feedback"))
+		{
+			trace("Transform feedback not available.");
+		}
+		else if (mGlslVersion >= 1.5)
+		{
+			mFeedbackShader = gl::GlslProg(loadResource(RES_SHADER_FEEDBACK_VERT_150));
+			mMeshShader = gl::GlslProg(
+				loadResource(RES_SHADER_MESH_VERT_150), 
+				loadResource(RES_SHADER_VBO_FRAG_150)
+				);
+			bindFeedbackVaryings(mFeedbackShader);
+			bindFragData(mMeshShader);
+		}
+		else
+		{
+			mFeedbackShader = gl::GlslProg(loadResource(RES_SHADER_FEEDBACK_VERT_120));
+			mMeshShader = gl::GlslProg(
+				loadResource(RES_SHADER_MESH_VERT_120), 
+				loadResource(RES_SHADER_VBO_FRAG_120)
+				);
+			bindFeedbackVaryings(mFeedbackShader);
+		}
+	}
+	catch (gl::GlslProgCompileExc & ex)
+	{
+		trace("Transform feedback not available.");
+		trace(ex.what());
+	}
+	catch (...)
+	{
+		trace("Transform feedback not available.");
+	}
+
+	// Load the strip shaders. Primitive restart is used 
+	// when it's available.
+	try
+	{
+		if (mGlslVersion >= 1.5)
+		{
+			mStripShader = gl::GlslProg(loadResource(RES_SHADER_STRIP_VERT_150), loadResource(RES_SHADER_VBO_FRAG_150));
+			bindFragData(mStripShader);
+		}
+		else
+		{
+			mStripShader = gl::GlslProg(loadResource(RES_SHADER_STRIP_VERT_120), loadResource(RES_SHADER_VBO_FRAG_120));
+		}
+		mStripRestart = gl::isExtensionAvailable("GL_NV_primitive_restart");
+	}
+	catch (gl::GlslProgCompileExc & ex)
+	{
+		trace("Triangle strips not available.");
+		trace(ex.what());
+	}
+	catch (...)
+	{
+		trace("Triangle strips not available.");
+	}
+
+	// Load the simulation shader
+	try
+	{
+		if (mGlslVersion >= 1.5)
+			mSimShader = gl::GlslProg(loadResource(RES_SHADER_FBO_VERT_150), loadResource(RES_SHADER_SIM_FRAG_150));
+		else
+			mSimShader = gl::GlslProg(loadResource(RES_SHADER_FBO_VERT_120), loadResource(RES_SHADER_SIM_FRAG_120));
+	}
+	catch (gl::GlslProgCompileExc & ex)
+	{
+		trace("Simulation not available.");
+		trace(ex.what());
+	}
+	catch (...)
+	{
+		trace("Simulation not available.");
+	}
+
 }
 
 // Handles mouse down event
@@ -477,6 +1585,58 @@ void MeshApp::prepareSettings(ci::app::AppBasic::Settings * settings)
 
 }
 
+// Maps a slot's buffer and copies its pixels into a frame 
+// for the exporter. The writer thread decodes them.
+void MeshApp::readbackSlot(ReadbackSlot & slot)
+{
+
+	// Bail if the writer is behind. The exporter counts the drop.
+	slot.mPending = false;
+	MeshExporter::Frame * frame = mExporter.acquire(slot.mWidth, slot.mHeight, slot.mBytes);
+	if (frame == 0)
+		return;
+
+	// Copy pixels as they are
+	frame->mDecode = slot.mDecode;
+	frame->mType = slot.mType;
+	slot.mPbo.bind();
+	const uint8_t * pixels = (const uint8_t *)slot.mPbo.map(GL_READ_ONLY);
+	if (pixels != 0)
+	{
+		if (!frame->mData.empty())
+			memcpy(& frame->mData[0], pixels, frame->mData.size());
+		slot.mPbo.unmap();
+	}
+	slot.mPbo.unbind();
+
+	// Queue the frame
+	mExporter.write(frame);
+
+}
+
+// Clears the simulation to still water
+void MeshApp::resetSimulation()
+{
+
+	// Bail if the simulation didn't load
+	if (!mSimFbo[0] || !mSimFbo[1])
+		return;
+
+	// Zero both heights in both FBOs
+	for (int32_t i = 0; i < 2; i++)
+	{
+		mSimFbo[i].bindFramebuffer();
+		glDrawBuffer(mColorAttachment[0]);
+		gl::clear(ColorAf::black(), true);
+		mSimFbo[i].unbindFramebuffer();
+	}
+	mSimDropTime = 0.0f;
+	mSimIndex = 0;
+	mSimStepTime = 0.0f;
+	mWaveDirty = true;
+
+}
+
 // Handles window resize event
 void MeshApp::resize(ResizeEvent event)
 {
@@ -504,6 +1664,165 @@ void MeshApp::resize(ResizeEvent event)
 	glPointSize(3.0f);
 	gl::color(ColorAf::white());
 
+	// Size the transparency targets to the window
+	if (!mOitFbo || mOitFbo.getSize() != getWindowSize())
+	{
+		try
+		{
+			mOitFbo = gl::Fbo(getWindowWidth(), getWindowHeight(), mOitFormat);
+		}
+		catch (...)
+		{
+			trace("Unable to create transparency targets.");
+			mOitFbo = gl::Fbo();
+		}
+	}
+
+}
+
+// Times the simulation alone at several grid sizes. Each 
+// size runs a batch of steps with no drawing in between.
+void MeshApp::runSimBenchmark()
+{
+
+	// Bail if the simulation didn't load
+	if (!mSimShader)
+	{
+		trace("Simulation benchmark: not available");
+		return;
+	}
+
+	// Remember settings so we can restore them
+	int32_t meshHeight = mMeshHeight;
+	int32_t meshWidth = mMeshWidth;
+	bool simEnabled = mSimEnabled;
+	mSimEnabled = true;
+	trace("Simulation benchmark: grid, ms per step, steps/sec, texels/sec");
+
+	// Sweep from 512x512 to 2048x2048
+	for (int32_t size = 512; size <= 2048; size *= 2)
+	{
+
+		// Build the grid. This also resets the simulation.
+		mMeshHeight = size;
+		mMeshHeightPrev = mMeshHeight;
+		mMeshWidth = size;
+		mMeshWidthPrev = mMeshWidth;
+		initMesh();
+
+		// Start a wave so there's something to step. We call 
+		// glFinish() so we measure the GPU's work, not just 
+		// the submission.
+		Vec2f center((float)size * 0.5f / (float)mCapacity.x, (float)size * 0.5f / (float)mCapacity.y);
+		stepSimulation(1, Vec4f(center.x, center.y, (float)size / 32.0f, 1.0f));
+		glFinish();
+		Timer timer(true);
+		stepSimulation(SIM_BENCHMARK_STEPS, Vec4f::zero());
+		glFinish();
+		double seconds = math<double>::max(timer.getSeconds(), 0.000001);
+
+		// Report
+		double steps = (double)SIM_BENCHMARK_STEPS;
+		trace(toString(size) + "x" + toString(size) + ", " + 
+			toString(seconds * 1000.0 / steps) + ", " + 
+			toString(steps / seconds) + ", " + toString(steps * (double)size * (double)size / seconds));
+
+	}
+
+	// Restore settings
+	mMeshHeight = meshHeight;
+	mMeshHeightPrev = mMeshHeight;
+	mMeshWidth = meshWidth;
+	mMeshWidthPrev = mMeshWidth;
+	mSimEnabled = simEnabled;
+	initMesh();
+
+}
+
+// Times the point shader against the strips across grid 
+// sizes. Both include the wave pass, and the strips include 
+// their normal pass.
+void MeshApp::runStripBenchmark()
+{
+
+	// Remember settings so we can restore them
+	bool feedbackEnabled = mFeedbackEnabled;
+	int32_t meshHeight = mMeshHeight;
+	int32_t meshWidth = mMeshWidth;
+	bool oitEnabled = mOitEnabled;
+	bool stripEnabled = mStripEnabled;
+	bool transform = mTransform;
+	mFeedbackEnabled = false;
+	mOitEnabled = false;
+	mTransform = true;
+	mTransformPrev = mTransform;
+	mVboShader = mVboShaderTransform;
+	trace("Strip benchmark: grid, path, ms, vertices/sec, triangles/sec");
+
+	// Sweep from 256x256 to 2048x2048
+	for (int32_t size = 256; size <= 2048; size *= 2)
+	{
+
+		// Build the grid
+		mMeshHeight = size;
+		mMeshHeightPrev = mMeshHeight;
+		mMeshWidth = size;
+		mMeshWidthPrev = mMeshWidth;
+		initMesh();
+		double vertices = (double)size * (double)size * (double)BENCHMARK_FRAMES;
+		double triangles = (double)(size - 1) * (double)(size - 1) * 2.0 * (double)BENCHMARK_FRAMES;
+
+		// Geometry shader, then strips
+		for (int32_t i = 0; i < 2; i++)
+		{
+
+			// Skip strips if they didn't load
+			mStripEnabled = i > 0;
+			string path = mStripEnabled ? "strips" : "points";
+			if (mStripEnabled && !isStripActive())
+			{
+				trace(toString(size) + "x" + toString(size) + ", " + path + ", not available");
+				continue;
+			}
+
+			// Time the frame. We call glFinish() so we 
+			// measure the GPU's work, not just the submission.
+			glFinish();
+			Timer timer(true);
+			for (int32_t frame = 0; frame < BENCHMARK_FRAMES; frame++)
+			{
+				mWaveDirty = true;
+				update();
+				gl::setViewport(getWindowBounds());
+				gl::setMatrices(mCamera);
+				gl::clear(mBackgroundColor, true);
+				drawMesh(false);
+				glFinish();
+			}
+			double seconds = math<double>::max(timer.getSeconds(), 0.000001);
+
+			// Report
+			trace(toString(size) + "x" + toString(size) + ", " + path + ", " + 
+				toString(seconds * 1000.0 / (double)BENCHMARK_FRAMES) + ", " + 
+				toString(vertices / seconds) + ", " + toString(triangles / seconds));
+
+		}
+
+	}
+
+	// Restore settings
+	mFeedbackEnabled = feedbackEnabled;
+	mMeshHeight = meshHeight;
+	mMeshHeightPrev = mMeshHeight;
+	mMeshWidth = meshWidth;
+	mMeshWidthPrev = mMeshWidth;
+	mOitEnabled = oitEnabled;
+	mStripEnabled = stripEnabled;
+	mTransform = transform;
+	mTransformPrev = mTransform;
+	mVboShader = mTransform ? mVboShaderTransform : mVboShaderPassThru;
+	initMesh();
+
 }
 
 // Take screen shot
@@ -520,30 +1839,116 @@ void MeshApp::setup()
 {
 
 	// Load the shader
+	mStripRestart = false;
 	loadShaders();
 
 	// Enable geometry transformation
 	mTransform = true;
 	mTransformPrev = mTransform;
 
-	// Set VBO layout
-	mVboLayout.setStaticIndices();
+	// Set VBO layout. Storage is allocated in ::initMesh().
+	mCapacity = Vec2i::zero();
 	mVboLayout.setStaticPositions();
 	mVboLayout.setStaticTexCoords2d();
 
 	// Set up FBO format
 	mFboFormat.enableDepthBuffer(false);
-	mFboFormat.enableColorBuffer(true, 1);
+	mFboFormat.enableColorBuffer(true, 2);
 	mFboFormat.setMinFilter(GL_NEAREST);
 	mFboFormat.setMagFilter(GL_NEAREST);
-	mFboFormat.setColorInternalFormat(GL_RGBA_FLOAT32_ATI);
+	mFboFormat.setColorInternalFormat(GL_RGBA32F_ARB);
 	
-	// Set color attachment buffer. We're only using one
-	// attachment, but it needs to be held in an array.
+	// Set color attachment buffers. The wave pass writes 
+	// positions to the first and normals to the second.
 	mColorAttachment[0] = GL_COLOR_ATTACHMENT0_EXT;
+	mColorAttachment[1] = GL_COLOR_ATTACHMENT1_EXT;
 
 	// Set up the texture format for 
-	mTextureFormat.setInternalFormat(GL_RGBA_FLOAT32_ATI);
+	mTextureFormat.setInternalFormat(GL_RGBA32F_ARB);
+	mTextureChannels = 4;
+	mTextureDataFormat = GL_RGBA;
+
+	// The source positions are whole numbers no larger than
+	// the grid, with z at zero, so two half floats hold them
+	// exactly. Use two full floats if the driver won't make
+	// an RG16F texture, and four channels if RG is missing.
+	if (gl::isExtensionAvailable("GL_ARB_texture_float"))
+	{
+		if (gl::isExtensionAvailable("GL_ARB_texture_rg"))
+		{
+			mTextureChannels = 2;
+			mTextureDataFormat = GL_RG;
+			mTextureFormat.setInternalFormat(GL_RG16F);
+			glGetError();
+			gl::Texture texture(1, 1, mTextureFormat);
+			if (glGetError() == GL_NO_ERROR)
+			{
+				trace("Source position format: RG16F, 4 bytes per point");
+			}
+			else
+			{
+				mTextureFormat.setInternalFormat(GL_RG32F);
+				trace("Source position format: RG32F, 8 bytes per point");
+			}
+		}
+		else
+		{
+			mTextureFormat.setInternalFormat(GL_RGBA16F_ARB);
+			trace("Source position format: RGBA16F, 8 bytes per point");
+		}
+	}
+	else
+	{
+		trace("Source position format: RGBA32F, 16 bytes per point");
+	}
+
+	// The simulation keeps the current and previous height 
+	// for each point, so it only needs two channels
+	mSimFormat.enableDepthBuffer(false);
+	mSimFormat.enableColorBuffer(true, 1);
+	mSimFormat.setMinFilter(GL_NEAREST);
+	mSimFormat.setMagFilter(GL_NEAREST);
+	mSimFormat.setColorInternalFormat(mTextureChannels == 2 ? GL_RG32F : GL_RGBA32F_ARB);
+
+	// FBO position formats, smallest first. Each has the largest
+	// grid it holds precisely. The FBO's format is picked in 
+	// ::initMesh(), once the grid's size is known. The wave
+	// moves z, and normals share the format, so the FBO always
+	// needs three channels. RGBA16F is left out since RGBA16 is
+	// the same size and holds a larger grid.
+	mNormalDecode = Vec2f(1.0f, 0.0f);
+	mPositionDecode = Vec2f(1.0f, 0.0f);
+	mPositionFormats.push_back(PositionFormat("RGB10_A2", GL_RGB10_A2, GL_UNSIGNED_INT_2_10_10_10_REV, 4, true, 128));
+	mPositionFormats.push_back(PositionFormat("RGBA16", GL_RGBA16, GL_UNSIGNED_SHORT, 8, true, 8192));
+	mPositionFormats.push_back(PositionFormat("RGBA32F", GL_RGBA32F_ARB, GL_FLOAT, 16, false, 8192));
+	mPositionFormat = mPositionFormats.size();
+
+	// Transparency uses two floating point color targets. We
+	// write to both at once, so the attachments are held
+	// in an array.
+	mOitAttachments[0] = GL_COLOR_ATTACHMENT0_EXT;
+	mOitAttachments[1] = GL_COLOR_ATTACHMENT1_EXT;
+	mOitEnabled = false;
+	mOitFormat.enableDepthBuffer(false);
+	mOitFormat.enableColorBuffer(true, 2);
+	mOitFormat.setMinFilter(GL_NEAREST);
+	mOitFormat.setMagFilter(GL_NEAREST);
+	mOitFormat.setColorInternalFormat(GL_RGBA_FLOAT32_ATI);
+
+	// Transform feedback is off by default
+	mFeedbackEnabled = false;
+	mFeedbackIndexCount = 0;
+
+	// Triangle strips are off by default
+	mStripEnabled = false;
+	mStripIndexCount = 0;
+
+	// Run the wave pass on the first frame
+	mElapsedSeconds = 0.0f;
+	mWaveDirty = true;
+	mWavePaused = false;
+	mWaveTime = 0.0f;
+	mWaveUpdated = false;
 
 	// Intialize camera
 	mEyePoint = Vec3f::zero();
@@ -585,8 +1990,40 @@ void MeshApp::setup()
 	mLightShininess = 20.0f;
 	mLightSpecular = ColorAf(0.75f, 0.75f, 0.75f, 1.0f);
 
+	// The simulation starts off. Speed is the wave speed squared
+	// over the grid spacing squared, and must stay under 0.5 for 
+	// the steps to be stable. Steps run at a fixed rate, and 
+	// substeps caps how many run in one frame.
+	mSimDamping = 0.995f;
+	mSimDropRate = 2.0f;
+	mSimDropTime = 0.0f;
+	mSimEnabled = false;
+	mSimIndex = 0;
+	mSimSpeed = 0.25f;
+	mSimStepTime = 0.0f;
+	mSimSubsteps = 4;
+	mWaveSimPrev = false;
+
+	// Nothing is recorded until asked
+	vector<string> exportFormats;
+	exportFormats.push_back("PLY");
+	exportFormats.push_back("OBJ");
+	mExportDropped = 0;
+	mExportFormat = MeshExporter::FORMAT_PLY;
+	mExportQueued = 0;
+	mReadbackIndex = 0;
+	for (int32_t i = 0; i < READBACK_RING_SIZE; i++)
+	{
+		mReadbackSlots[i].mBytes = 0;
+		mReadbackSlots[i].mDecode = Vec2f(1.0f, 0.0f);
+		mReadbackSlots[i].mHeight = 0;
+		mReadbackSlots[i].mPending = false;
+		mReadbackSlots[i].mType = GL_FLOAT;
+		mReadbackSlots[i].mWidth = 0;
+	}
+
 	// Create the parameters bar
-	mParams = params::InterfaceGl("Parameters", Vec2i(250, 390));
+	mParams = params::InterfaceGl("Parameters", Vec2i(250, 660));
 	mParams.addSeparator("");
 	mParams.addText("Hold ALT to rotate");
 	mParams.addText("Hold SHIFT to drag");
@@ -599,10 +2036,31 @@ void MeshApp::setup()
 	mParams.addParam("Mesh wave amplitude", & mMeshWaveAmplitude, "min=0.000 max=30000.000 step=0.001 keyDecr=e keyIncr=E");
 	mParams.addParam("Mesh wave speed", & mMeshWaveSpeed, "min=0.000 max=100.000 step=0.001 keyDecr=f keyIncr=F");
 	mParams.addParam("Mesh wave width", & mMeshWaveWidth, "min=0.000 max=30000.000 step=0.001 keyDecr=g keyIncr=G");
+	mParams.addParam("Mesh wave paused", & mWavePaused, "key=n");
+	mParams.addParam("Mesh wave updated", & mWaveUpdated, "", true);
+	mParams.addButton("Check wave on CPU", std::bind(& MeshApp::checkWave, this), "key=s");
 	mParams.addParam("Show FBO", & mDrawFbo, "key=h");
 	mParams.addSeparator("");
 	mParams.addParam("Light position", & mLightPosition);
 	mParams.addSeparator("");
+	mParams.addParam("Order independent transparency", & mOitEnabled, "key=j");
+	mParams.addParam("Transform feedback", & mFeedbackEnabled, "key=k");
+	mParams.addParam("Triangle strips", & mStripEnabled, "key=l");
+	mParams.addButton("Run strip benchmark", std::bind(& MeshApp::runStripBenchmark, this), "key=m");
+	mParams.addSeparator("");
+	mParams.addParam("Simulation", & mSimEnabled, "key=p");
+	mParams.addParam("Simulation max substeps", & mSimSubsteps, "min=1 max=64 step=1");
+	mParams.addParam("Simulation speed", & mSimSpeed, "min=0.000 max=0.499 step=0.001");
+	mParams.addParam("Simulation damping", & mSimDamping, "min=0.900 max=1.000 step=0.001");
+	mParams.addParam("Simulation drops/sec", & mSimDropRate, "min=0.0 max=60.0 step=0.5");
+	mParams.addButton("Reset simulation", std::bind(& MeshApp::resetSimulation, this), "key=r");
+	mParams.addButton("Run simulation benchmark", std::bind(& MeshApp::runSimBenchmark, this), "key=q");
+	mParams.addSeparator("");
+	mParams.addParam("Export format", exportFormats, & mExportFormat);
+	mParams.addButton("Record mesh", std::bind(& MeshApp::toggleExport, this), "key=o");
+	mParams.addParam("Frames exported", & mExportQueued, "", true);
+	mParams.addParam("Frames dropped", & mExportDropped, "", true);
+	mParams.addSeparator("");
 	mParams.addParam("Frame rate", & mFrameRate, "", true);
 	mParams.addParam("Full screen", & mFullScreen, "key=i");
 	mParams.addButton("Save screen shot", std::bind(& MeshApp::screenShot, this), "key=space");
@@ -617,16 +2075,47 @@ void MeshApp::setup()
 void MeshApp::shutdown()
 {
 
+	// Stop recording
+	if (mExporter.isOpen())
+		toggleExport();
+	for (int32_t i = 0; i < READBACK_RING_SIZE; i++)
+		if (mReadbackSlots[i].mPbo)
+			mReadbackSlots[i].mPbo.reset();
+
 	// Clean up
 	if (mFbo)
 		mFbo.reset();
 	if (mFboShader)
 		mFboShader.reset();
-	if (mSurfacePosition)
-		mSurfacePosition.reset();
+	if (mFeedbackBuffer)
+		mFeedbackBuffer.reset();
+	if (mFeedbackIndices)
+		mFeedbackIndices.reset();
+	if (mFeedbackShader)
+		mFeedbackShader.reset();
+	if (mMeshShader)
+		mMeshShader.reset();
+	if (mOitFbo)
+		mOitFbo.reset();
+	if (mResolveShader)
+		mResolveShader.reset();
+	for (int32_t i = 0; i < 2; i++)
+		if (mSimFbo[i])
+			mSimFbo[i].reset();
+	if (mSimShader)
+		mSimShader.reset();
+	if (mStripIndices)
+		mStripIndices.reset();
+	if (mStripShader)
+		mStripShader.reset();
+	mStripRowCounts.clear();
+	mStripRowOffsets.clear();
+	if (mPbo)
+		mPbo.reset();
 	if (mTexturePosition)
 		mTexturePosition.reset();
-	mVboIndices.clear();
+	mVboCounts.clear();
+	mVboFirsts.clear();
 	if (mVboMesh)
 		mVboMesh.reset();
 	if (mVboShader)
@@ -640,6 +2129,81 @@ void MeshApp::shutdown()
 
 }
 
+// Runs steps of the simulation, swapping FBOs after each one
+void MeshApp::stepSimulation(int32_t steps, const Vec4f & drop)
+{
+
+	// Set up the window to render to the FBOs
+	gl::setMatricesWindow(mSimFbo[0].getSize(), false);
+	gl::setViewport(mSimFbo[0].getBounds());
+
+	// Bind and configure the simulation shader
+	Vec4f noDrop = Vec4f::zero();
+	mSimShader.bind();
+	mSimShader.uniform("damping", mSimDamping);
+	mSimShader.uniform("extent", Vec2f((float)(mMeshWidth - 1) / (float)mCapacity.x, (float)(mMeshHeight - 1) / (float)mCapacity.y));
+	mSimShader.uniform("pixel", Vec2f(1.0f / (float)mCapacity.x, 1.0f / (float)mCapacity.y));
+	mSimShader.uniform("speed", mSimSpeed);
+	mSimShader.uniform("state", 0);
+
+	// Each step reads the FBO the last step wrote and renders 
+	// to the other one. The drop only lands on the first step.
+	for (int32_t i = 0; i < steps; i++)
+	{
+		gl::Fbo & target = mSimFbo[1 - mSimIndex];
+		mSimShader.uniform("drop", i == 0 ? & drop : & noDrop, 1);
+		target.bindFramebuffer();
+		glDrawBuffer(mColorAttachment[0]);
+		mSimFbo[mSimIndex].bindTexture(0);
+		drawFboQuad();
+		mSimFbo[mSimIndex].unbindTexture();
+		target.unbindFramebuffer();
+		mSimIndex = 1 - mSimIndex;
+	}
+
+	// Clean up
+	mSimShader.unbind();
+
+}
+
+// Starts or stops recording the mesh to disk
+void MeshApp::toggleExport()
+{
+
+	// Stop recording. Reads still in the ring are 
+	// handed over first, which waits on the GPU once.
+	if (mExporter.isOpen())
+	{
+		for (int32_t i = 0; i < READBACK_RING_SIZE; i++)
+		{
+			ReadbackSlot & slot = mReadbackSlots[(mReadbackIndex + i) % READBACK_RING_SIZE];
+			if (slot.mPending)
+				readbackSlot(slot);
+		}
+		mExportDropped = mExporter.getDroppedCount();
+		mExportQueued = mExporter.getQueuedCount();
+		mExporter.close();
+		trace("Mesh export stopped: " + toString(mExportQueued) + " frames queued, " + 
+			toString(mExportDropped) + " dropped, " + toString(mExporter.getFailedCount()) + " failed");
+		return;
+	}
+
+	// Start a new sequence in the application folder
+	fs::path directory = fs::path(getAppPath().generic_string() + "mesh" + toString(getElapsedFrames()));
+	if (!mExporter.open(directory, mExportFormat))
+	{
+		trace("Unable to create " + directory.string());
+		return;
+	}
+	mExportDropped = 0;
+	mExportQueued = 0;
+	mReadbackIndex = 0;
+	for (int32_t i = 0; i < READBACK_RING_SIZE; i++)
+		mReadbackSlots[i].mPending = false;
+	trace("Mesh export started: " + directory.string());
+
+}
+
 // This method borrows the term "trace" from ActionScript.
 // This is a convenience method for writing a line to the
 // console and (on Windows) debug window
@@ -658,9 +2222,14 @@ void MeshApp::trace(const string & message)
 void MeshApp::update()
 {
 
-	// Update frame rate and elapsed time
+	// Update frame rate and elapsed time. The wave's 
+	// clock stops while it's paused.
+	float elapsedSeconds = (float)getElapsedSeconds();
+	float deltaSeconds = elapsedSeconds - mElapsedSeconds;
+	if (!mWavePaused)
+		mWaveTime += deltaSeconds;
 	mElapsedFrames = (float)getElapsedFrames();
-	mElapsedSeconds = (float)getElapsedSeconds();
+	mElapsedSeconds = elapsedSeconds;
 	mFrameRate = getAverageFps();
 
 	// Update mesh if dimensions change
@@ -689,6 +2258,80 @@ void MeshApp::update()
 	// Update camera
 	mCamera.lookAt(mEyePoint, mLookAt);
 
+	// Step the simulation at a fixed rate, so waves move at 
+	// the same speed whatever the frame rate. A frame runs no 
+	// more than mSimSubsteps steps, and time past that is let
+	// go so a slow frame doesn't snowball. Drops land at random 
+	// at the chosen rate, and nothing moves while it's paused.
+	bool simulate = isSimActive();
+	if (simulate && !mWavePaused)
+	{
+		mSimDropTime += deltaSeconds * mSimDropRate;
+		mSimStepTime += deltaSeconds * (float)SIM_STEP_RATE;
+		int32_t steps = math<int32_t>::min((int32_t)mSimStepTime, mSimSubsteps);
+		mSimStepTime = math<float>::fmod(mSimStepTime, 1.0f);
+		if (steps > 0)
+		{
+			Vec4f drop = Vec4f::zero();
+			if (mSimDropTime >= 1.0f)
+			{
+				mSimDropTime = math<float>::fmod(mSimDropTime, 1.0f);
+				float radius = math<float>::max((float)math<int32_t>::max(mMeshWidth, mMeshHeight) / 32.0f, 2.0f);
+				drop = Vec4f(Rand::randFloat(0.0f, (float)mMeshWidth / (float)mCapacity.x), 
+					Rand::randFloat(0.0f, (float)mMeshHeight / (float)mCapacity.y), radius, 1.0f);
+			}
+			stepSimulation(steps, drop);
+			mWaveDirty = true;
+		}
+	}
+
+	// The shader only sees phase times speed, so a 
+	// speed of zero leaves the wave still
+	bool feedback = isFeedbackActive();
+	bool shown = mDrawFbo || mExporter.isOpen();
+	float wavePhase = mWaveTime * mMeshWaveSpeed;
+	mWaveUpdated = mWaveDirty || 
+		wavePhase != mWavePhasePrev || 
+		mMeshWaveAmplitude != mWaveAmplitudePrev || 
+		mMeshScale != mWaveScalePrev || 
+		mMeshWaveWidth != mWaveWidthPrev || 
+		feedback != mWaveFeedbackPrev || 
+		shown != mWaveShownPrev || 
+		simulate != mWaveSimPrev;
+	if (!mWaveUpdated)
+		return;
+	mWaveAmplitudePrev = mMeshWaveAmplitude;
+	mWaveDirty = false;
+	mWaveFeedbackPrev = feedback;
+	mWavePhasePrev = wavePhase;
+	mWaveScalePrev = mMeshScale;
+	mWaveShownPrev = shown;
+	mWaveSimPrev = simulate;
+	mWaveWidthPrev = mMeshWaveWidth;
+
+	// Normalized formats hold positions as zero to one. Scale 
+	// them to the farthest the wave can reach. Normals only 
+	// need to reach from minus one to one.
+	mNormalDecode = Vec2f(1.0f, 0.0f);
+	mPositionDecode = Vec2f(1.0f, 0.0f);
+	if (mPositionFormat < mPositionFormats.size() && mPositionFormats[mPositionFormat].mNormalized)
+	{
+		mNormalDecode = Vec2f(2.0f, -1.0f);
+		float range = ((float)math<int32_t>::max(mMeshWidth, mMeshHeight) + math<float>::abs(mMeshWaveAmplitude)) * math<float>::abs(mMeshScale);
+		range = math<float>::max(range, 1.0f);
+		mPositionDecode = Vec2f(range * 2.0f, -range);
+	}
+
+	// With transform feedback on, the wave pass writes to the 
+	// feedback buffer instead. The FBO is only updated when 
+	// it's being shown or exported.
+	if (feedback)
+	{
+		updateFeedback();
+		if (!shown)
+			return;
+	}
+
 	/*
 	 * In the routine below, we'll bind the FBO as our
 	 * render target, and the position texture as an input.
@@ -704,40 +2347,40 @@ void MeshApp::update()
 	mFbo.bindFramebuffer();
 
 	// This tells OpenGL that we're going to render to 
-	// the color attachment
-	glDrawBuffers(1, mColorAttachment);
+	// both color attachments
+	glDrawBuffers(2, mColorAttachment);
 
-	// Bind the position texture as the data source
+	// Bind the position texture as the data source, 
+	// and the simulation's heights when it's running
 	mTexturePosition.bind(0);
+	if (simulate)
+		mSimFbo[mSimIndex].bindTexture(1);
 
 	// Bind and configure the FBO shader
 	mFboShader.bind();
 	mFboShader.uniform("amp", mMeshWaveAmplitude);
 	mFboShader.uniform("alpha", mMeshAlpha);
-	mFboShader.uniform("phase", mElapsedSeconds);
+	mFboShader.uniform("extent", Vec2f((float)(mMeshWidth - 1) / (float)mCapacity.x, (float)(mMeshHeight - 1) / (float)mCapacity.y));
+	mFboShader.uniform("heights", 1);
+	mFboShader.uniform("normalDecode", mNormalDecode);
+	mFboShader.uniform("phase", mWaveTime);
+	mFboShader.uniform("pixel", Vec2f(1.0f / (float)mCapacity.x, 1.0f / (float)mCapacity.y));
+	mFboShader.uniform("positionDecode", mPositionDecode);
 	mFboShader.uniform("positions", 0);
 	mFboShader.uniform("scale", mMeshScale);
+	mFboShader.uniform("simulate", simulate);
 	mFboShader.uniform("speed", mMeshWaveSpeed);
 	mFboShader.uniform("width", mMeshWaveWidth);
 
-	// Draw a quad at the texture's size to process the FBO.
-	glBegin(GL_QUADS);
-	{
-		glTexCoord2f(0.0f, 0.0f);
-		gl::vertex(0.0f, 0.0f);
-		glTexCoord2f(0.0f, 1.0f);
-		gl::vertex(0.0f, (float)mMeshHeight);
-		glTexCoord2f(1.0f, 1.0f);
-		gl::vertex((float)mMeshWidth, (float)mMeshHeight);
-		glTexCoord2f(1.0f, 0.0f);
-		gl::vertex((float)mMeshWidth, 0.0f);
-	}
-	glEnd();
+	// Draw a quad over the part of the FBO in use
+	drawFboQuad();
 	
 	// Unbind the shader
 	mFboShader.unbind();
 
-	// Unbind the input texture
+	// Unbind the input textures
+	if (simulate)
+		mSimFbo[mSimIndex].unbindTexture();
 	mTexturePosition.unbind();
 	
 	// Unbind the render target
@@ -745,5 +2388,44 @@ void MeshApp::update()
 
 }
 
+// Runs the wave pass on every point in use, capturing the
+// displaced positions into the feedback buffer
+void MeshApp::updateFeedback()
+{
+
+	// Bind the position texture as the data source
+	mTexturePosition.bind(0);
+
+	// Bind and configure the feedback shader
+	mFeedbackShader.bind();
+	mFeedbackShader.uniform("amp", mMeshWaveAmplitude);
+	mFeedbackShader.uniform("extent", Vec2f((float)(mMeshWidth - 1) / (float)mCapacity.x, (float)(mMeshHeight - 1) / (float)mCapacity.y));
+	mFeedbackShader.uniform("phase", mWaveTime);
+	mFeedbackShader.uniform("pixel", Vec2f(1.0f / (float)mCapacity.x, 1.0f / (float)mCapacity.y));
+	mFeedbackShader.uniform("positions", 0);
+	mFeedbackShader.uniform("scale", mMeshScale);
+	mFeedbackShader.uniform("speed", mMeshWaveSpeed);
+	mFeedbackShader.uniform("width", mMeshWaveWidth);
+
+	// Nothing is drawn in this pass. Points go in and 
+	// their outputs are written to the buffer.
+	glEnable(GL_RASTERIZER_DISCARD_EXT);
+	glBindBufferBaseEXT(GL_TRANSFORM_FEEDBACK_BUFFER_EXT, 0, mFeedbackBuffer.getId());
+	glBeginTransformFeedbackEXT(GL_POINTS);
+	mVboMesh.enableClientStates();
+	mVboMesh.bindAllData();
+	glMultiDrawArrays(GL_POINTS, &mVboFirsts[0], &mVboCounts[0], (GLsizei)mVboFirsts.size());
+	mVboMesh.unbindBuffers();
+	mVboMesh.disableClientStates();
+	glEndTransformFeedbackEXT();
+	glBindBufferBaseEXT(GL_TRANSFORM_FEEDBACK_BUFFER_EXT, 0, 0);
+	glDisable(GL_RASTERIZER_DISCARD_EXT);
+
+	// Clean up
+	mFeedbackShader.unbind();
+	mTexturePosition.unbind();
+
+}
+
 // Run application
 CINDER_APP_BASIC(MeshApp, RendererGl)
@@ -6,5 +6,11 @@
 #define RES_SHADER_FRAG_150		CINDER_RESOURCE(../resources/, frag_150.glsl, 129, GLSL)
 #define RES_SHADER_GEOM_120		CINDER_RESOURCE(../resources/, geom_120.gs, 130, GLSL)
 #define RES_SHADER_GEOM_150		CINDER_RESOURCE(../resources/, geom_150.glsl, 131, GLSL)
+#define RES_SHADER_NORMAL_FRAG_120	CINDER_RESOURCE(../resources/, normal_frag_120.fs, 134, GLSL)
+#define RES_SHADER_NORMAL_FRAG_150	CINDER_RESOURCE(../resources/, normal_frag_150.glsl, 135, GLSL)
+#define RES_SHADER_NORMAL_VERT_120	CINDER_RESOURCE(../resources/, normal_vert_120.vs, 136, GLSL)
+#define RES_SHADER_NORMAL_VERT_150	CINDER_RESOURCE(../resources/, normal_vert_150.glsl, 137, GLSL)
+#define RES_SHADER_STRIP_VERT_120	CINDER_RESOURCE(../resources/, strip_vert_120.vs, 138, GLSL)
+#define RES_SHADER_STRIP_VERT_150	CINDER_RESOURCE(../resources/, strip_vert_150.glsl, 139, GLSL)
 #define RES_SHADER_VERT_120		CINDER_RESOURCE(../resources/, vert_120.vs, 132, GLSL)
 #define RES_SHADER_VERT_150		CINDER_RESOURCE(../resources/, vert_150.glsl, 133, GLSL)
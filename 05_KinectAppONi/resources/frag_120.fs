@@ -1,6 +1,7 @@
 #version 120
 
 // Uniforms
+uniform float brightTolerance;
 uniform vec3 eyePoint;
 uniform vec4 lightAmbient;
 uniform vec4 lightDiffuse;
@@ -27,6 +28,11 @@ void main(void)
 	if (transform)
 	{
 
+		// Strips can't leave out triangles between dark points 
+		// like the geometry shader does, so drop their fragments
+		if (brightnessOut <= brightTolerance)
+			discard;
+
 		// Normalized eye position
 		vec3 eye = normalize(-eyePoint);
 
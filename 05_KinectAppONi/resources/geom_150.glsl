@@ -25,6 +25,7 @@ void addVertex(vec4 vert, vec4 norm, float bright)
 {
 
 	// Assign values to output attributes
+	brightness = bright;
 	normal = norm;
 	position = vert;
 	gl_Position = vert;
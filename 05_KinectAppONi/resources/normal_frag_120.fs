@@ -0,0 +1,39 @@
+#version 120
+
+// Uniforms
+uniform float depth;
+uniform float height;
+uniform sampler2D positions;
+uniform vec3 scale;
+uniform float width;
+
+// Input attributes
+varying vec4 texCoord;
+
+// Finds the position of a neighboring point, relative 
+// to this one, the same way as the geometry shader
+vec3 getPosition(vec2 offset)
+{
+	float bright = texture2D(positions, texCoord.st + offset / vec2(width, height)).r;
+	return vec3(-offset.x * scale.x, offset.y * scale.y, depth * ((1.0 - bright) * scale.z));
+}
+
+// Kernel
+void main(void)
+{
+
+	// Read the neighboring positions
+	vec3 left = getPosition(vec2(-1.0, 0.0));
+	vec3 right = getPosition(vec2(1.0, 0.0));
+	vec3 top = getPosition(vec2(0.0, -1.0));
+	vec3 bottom = getPosition(vec2(0.0, 1.0));
+
+	// The normal is perpendicular to both directions across 
+	// the mesh. It faces the same way as the geometry 
+	// shader's normals.
+	vec3 normal = normalize(cross(bottom - top, right - left));
+
+	// Render normal to color attachment
+	gl_FragData[0] = vec4(normal.x, normal.y, normal.z, 0.0);
+
+}
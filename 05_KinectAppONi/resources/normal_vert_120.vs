@@ -0,0 +1,14 @@
+#version 120
+
+// Output attributes
+varying vec4 texCoord;
+
+// Kernel
+void main(void)
+{
+
+	// Set properties
+	texCoord = gl_MultiTexCoord0;
+	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+
+}
@@ -0,0 +1,16 @@
+// Adding the word "compatibility" let's us use 
+// legacy built-in uniforms
+#version 150 compatibility
+
+// Output attributes
+out vec4 texCoord;
+
+// Kernel
+void main(void)
+{
+
+	// Set properties
+	texCoord = gl_MultiTexCoord0;
+	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+
+}
@@ -0,0 +1,36 @@
+#version 120
+
+// Uniforms
+uniform float depth;
+uniform mat4 mvp;
+uniform sampler2D normals;
+uniform sampler2D positions;
+uniform vec3 scale;
+
+// Output attributes
+varying float brightnessOut;
+varying vec4 normalOut;
+varying vec4 positionOut;
+varying vec4 uvOut;
+
+// Kernel
+void main(void)
+{
+
+	// Read brightness
+	uvOut = gl_MultiTexCoord0;
+	brightnessOut = texture2D(positions, uvOut.st).r;
+
+	// Set depth and transform to world position, the 
+	// same as the geometry shader
+	vec4 vert = gl_Vertex;
+	vert.z = depth * ((1.0 - brightnessOut) * scale.z);
+	positionOut = mvp * (vert * vec4(-scale.x, scale.y, 1.0, 1.0));
+
+	// Read the normal from the normal pass
+	normalOut = vec4(normalize((mvp * vec4(texture2D(normals, uvOut.st).xyz, 0.0)).xyz), 0.0);
+
+	// Set position
+	gl_Position = positionOut;
+
+}
@@ -0,0 +1,38 @@
+// Adding the word "compatibility" let's us use 
+// legacy built-in uniforms
+#version 150 compatibility
+
+// Uniforms
+uniform float depth;
+uniform mat4 mvp;
+uniform sampler2D normals;
+uniform sampler2D positions;
+uniform vec3 scale;
+
+// Output attributes
+out float brightness;
+out vec4 normal;
+out vec4 position;
+out vec4 uv;
+
+// Kernel
+void main(void)
+{
+
+	// Read brightness
+	uv = gl_MultiTexCoord0;
+	brightness = texture2D(positions, uv.st).r;
+
+	// Set depth and transform to world position, the 
+	// same as the geometry shader
+	vec4 vert = gl_Vertex;
+	vert.z = depth * ((1.0 - brightness) * scale.z);
+	position = mvp * (vert * vec4(-scale.x, scale.y, 1.0, 1.0));
+
+	// Read the normal from the normal pass
+	normal = vec4(normalize((mvp * vec4(texture2D(normals, uv.st).xyz, 0.0)).xyz), 0.0);
+
+	// Set position
+	gl_Position = position;
+
+}
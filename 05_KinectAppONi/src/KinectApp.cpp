@@ -5,6 +5,7 @@
 #include "cinder/gl/Texture.h"
 
 #include "cinder/Camera.h"
+#include "cinder/gl/Fbo.h"
 #include "cinder/gl/GlslProg.h"
 #include "cinder/gl/Vbo.h"
 #include "cinder/ImageIo.h"
@@ -150,6 +151,22 @@ public:
 	std::vector<ci::Vec2f> mVboTexCoords;
 	ci::gl::VboMesh	mVboMesh;
     
+	// Triangle strips. Each pair of rows is one indexed strip,
+	// with a restart index between strips, so neighboring 
+	// triangles share transformed vertices. Normals are 
+	// computed per vertex in their own pass.
+	static const uint32_t STRIP_RESTART_INDEX = 0xFFFFFFFF;
+	void updateNormals();
+	ci::gl::Fbo mNormalFbo;
+	ci::gl::GlslProg mNormalShader;
+	bool mStripEnabled;
+	GLsizei mStripIndexCount;
+	ci::gl::Vbo mStripIndices;
+	bool mStripRestart;
+	std::vector<GLsizei> mStripRowCounts;
+	std::vector<const GLvoid *> mStripRowOffsets;
+	ci::gl::GlslProg mStripShader;
+    
 	// Window
 	ci::Colorf mBackgroundColor;
 	float mElapsedFrames;
@@ -244,6 +261,7 @@ void KinectApp::setup()
     mClearChannel = Channel( KINECT_COLOR_WIDTH, KINECT_COLOR_HEIGHT );
     
     // Load the shader
+	mStripRestart = false;
 	loadShaders();
     
     V::OpenNIDeviceManager::USE_THREAD = false;
@@ -293,11 +311,14 @@ void KinectApp::setup()
 	mTransform = true;
 	mTransformPrev = mTransform;
 	mScale = Vec3f(1.5f, 1.5f, 20.0f);
+	mStripEnabled = false;
+	mStripIndexCount = 0;
     
 	// Create the parameters bar
-	mParams = params::InterfaceGl("Parameters", Vec2i(250, 310));
+	mParams = params::InterfaceGl("Parameters", Vec2i(250, 330));
 	mParams.addSeparator("");
 	mParams.addParam("Transform enabled", & mTransform, "key=a");
+	mParams.addParam("Triangle strips", & mStripEnabled, "key=f");
 	mParams.addSeparator("");
 	mParams.addParam("Bright tolerance", & mBrightTolerance, "min=0.000 max=1.000 step=0.001 keyDecr=b keyIncr=B");
 	mParams.addParam("Depth", & mDepth, "min=0.0 max=2000.0 step=1.0 keyIncr=c keyDecr=C");
@@ -359,6 +380,10 @@ void KinectApp::update()
 		mTransformPrev = mTransform;
 	}
     
+	// Find normals for the strips
+	if (mStripEnabled && mTransform && mStripShader && mNormalFbo)
+		updateNormals();
+    
     if( _manager->getNumOfUsers() > 0 ) 
     {
         
@@ -385,6 +410,37 @@ void KinectApp::update()
 }
 
 
+// Finds a normal for every point from its neighbors' depth
+void KinectApp::updateNormals()
+{
+    
+	// Set up the window to render to the normal FBO
+	gl::pushMatrices();
+	gl::setMatricesWindow(mNormalFbo.getSize(), false);
+	gl::setViewport(mNormalFbo.getBounds());
+	mNormalFbo.bindFramebuffer();
+    
+	// Read depth from the Kinect
+	mDepthTexture.bind(0);
+	mNormalShader.bind();
+	mNormalShader.uniform("depth", mDepth);
+	mNormalShader.uniform("height", (float)MESH_HEIGHT);
+	mNormalShader.uniform("positions", 0);
+	mNormalShader.uniform("scale", mScale);
+	mNormalShader.uniform("width", (float)MESH_WIDTH);
+    
+	// Draw a quad over the FBO
+	gl::drawSolidRect(Rectf(mNormalFbo.getBounds()));
+    
+	// Clean up
+	mNormalShader.unbind();
+	mDepthTexture.unbind();
+	mNormalFbo.unbindFramebuffer();
+	gl::popMatrices();
+    
+}
+
+
 void KinectApp::draw()
 {
 	// Set up the scene
@@ -392,11 +448,17 @@ void KinectApp::draw()
 	gl::setViewport(getWindowBounds());
 	//gl::setMatrices(mCamera);
     
-	// Bind texture
+	// Choose shader
+	bool strip = mStripEnabled && mTransform && mStripShader && mNormalFbo;
+	gl::GlslProg & shader = strip ? mStripShader : mShader;
+    
+	// Bind textures
 	mDepthTexture.bind(0);
+	if (strip)
+		mNormalFbo.bindTexture(1, 0);
     
 	// Bind shader
-	mShader.bind();
+	shader.bind();
 	
 	// Position world
 	gl::pushModelView();
@@ -404,29 +466,59 @@ void KinectApp::draw()
 	gl::rotate(mRotation);
 	
 	// Set uniforms
-	mShader.uniform("brightTolerance", mBrightTolerance);
-	mShader.uniform("depth", mDepth);
-	mShader.uniform("eyePoint", mEyePoint);
-	mShader.uniform("height", (float)MESH_HEIGHT);
-	mShader.uniform("lightAmbient", mLightAmbient);
-	mShader.uniform("lightDiffuse", mLightDiffuse);
-	mShader.uniform("lightPosition", mLightPosition);
-	mShader.uniform("lightSpecular", mLightSpecular);
-	mShader.uniform("mvp", gl::getProjection() * gl::getModelView());
-	mShader.uniform("positions", 0);
-	mShader.uniform("scale", mScale);
-	mShader.uniform("shininess", mLightShininess);
-	mShader.uniform("transform", mTransform);
-	mShader.uniform("uvmix", mMeshUvMix);
-	mShader.uniform("width", (float)MESH_WIDTH);
+	shader.uniform("brightTolerance", mBrightTolerance);
+	shader.uniform("depth", mDepth);
+	shader.uniform("eyePoint", mEyePoint);
+	shader.uniform("height", (float)MESH_HEIGHT);
+	shader.uniform("lightAmbient", mLightAmbient);
+	shader.uniform("lightDiffuse", mLightDiffuse);
+	shader.uniform("lightPosition", mLightPosition);
+	shader.uniform("lightSpecular", mLightSpecular);
+	shader.uniform("mvp", gl::getProjection() * gl::getModelView());
+	shader.uniform("normals", 1);
+	shader.uniform("positions", 0);
+	shader.uniform("scale", mScale);
+	shader.uniform("shininess", mLightShininess);
+	shader.uniform("transform", mTransform);
+	shader.uniform("uvmix", mMeshUvMix);
+	shader.uniform("width", (float)MESH_WIDTH);
     
 	// Draw VBO
-	gl::draw(mVboMesh);
+	if (strip)
+	{
+        
+		// Draw strips through the points. Without primitive 
+		// restart, each strip is its own range of the indices.
+		mVboMesh.enableClientStates();
+		mVboMesh.bindAllData();
+		mStripIndices.bind();
+		if (mStripRestart)
+		{
+			glEnable(GL_PRIMITIVE_RESTART_NV);
+			glPrimitiveRestartIndexNV(STRIP_RESTART_INDEX);
+			glDrawElements(GL_TRIANGLE_STRIP, mStripIndexCount, GL_UNSIGNED_INT, 0);
+			glDisable(GL_PRIMITIVE_RESTART_NV);
+		}
+		else
+		{
+			glMultiDrawElements(GL_TRIANGLE_STRIP, &mStripRowCounts[0], GL_UNSIGNED_INT, &mStripRowOffsets[0], (GLsizei)mStripRowCounts.size());
+		}
+		mStripIndices.unbind();
+		mVboMesh.unbindBuffers();
+		mVboMesh.disableClientStates();
+        
+	}
+	else
+	{
+		gl::draw(mVboMesh);
+	}
     
 	// Stop drawing
 	gl::popModelView();
-	mShader.unbind();
+	shader.unbind();
     
+	if (strip)
+		mNormalFbo.getTexture().unbind(1);
     mDepthTexture.unbind();
     
     // debug draw
@@ -479,6 +571,50 @@ void KinectApp::initMesh()
 	mVboTexCoords.clear();
 	mVboVertices.clear();
     
+	// Index the strips. Each pair of rows is one strip, 
+	// zig-zagging down and across so its triangles are 
+	// wound the same as the geometry shader's.
+	mStripRowCounts.clear();
+	mStripRowOffsets.clear();
+	for (int32_t y = 0; y < MESH_HEIGHT - 1; y++)
+	{
+        
+		// Separate from the previous strip
+		if (y > 0)
+			mVboIndices.push_back(STRIP_RESTART_INDEX);
+        
+		// Remember where the strip is for drawing 
+		// without primitive restart
+		mStripRowCounts.push_back(MESH_WIDTH * 2);
+		mStripRowOffsets.push_back((const GLvoid *)(mVboIndices.size() * sizeof(uint32_t)));
+        
+		// Add the strip
+		for (int32_t x = 0; x < MESH_WIDTH; x++)
+		{
+			mVboIndices.push_back(x + y * MESH_WIDTH);
+			mVboIndices.push_back(x + (y + 1) * MESH_WIDTH);
+		}
+        
+	}
+	if (!mStripIndices)
+		mStripIndices = gl::Vbo(GL_ELEMENT_ARRAY_BUFFER);
+	mStripIndexCount = (GLsizei)mVboIndices.size();
+	mStripIndices.bind();
+	mStripIndices.bufferData(mVboIndices.size() * sizeof(uint32_t), &mVboIndices[0], GL_STATIC_DRAW);
+	mStripIndices.unbind();
+	mVboIndices.clear();
+    
+	// Strips read normals from an FBO the size of the mesh
+	if (mStripShader && mNormalShader)
+	{
+		gl::Fbo::Format format;
+		format.enableDepthBuffer(false);
+		format.setMinFilter(GL_NEAREST);
+		format.setMagFilter(GL_NEAREST);
+		format.setColorInternalFormat(GL_RGBA_FLOAT32_ATI);
+		mNormalFbo = gl::Fbo(MESH_WIDTH, MESH_HEIGHT, format);
+	}
+    
 	// Call the resize event to reset the camera 
 	// and OpenGL state
 	resize(ResizeEvent(getWindowSize()));
@@ -496,6 +632,16 @@ void KinectApp::shutdown()
 	// Clean up
 	if (mDepthTexture)
 		mDepthTexture.reset();
+	if (mNormalFbo)
+		mNormalFbo.reset();
+	if (mNormalShader)
+		mNormalShader.reset();
+	if (mStripIndices)
+		mStripIndices.reset();
+	if (mStripShader)
+		mStripShader.reset();
+	mStripRowCounts.clear();
+	mStripRowOffsets.clear();
 	mVboIndices.clear();
 	if (mVboMesh)
 		mVboMesh.reset();
@@ -636,6 +782,33 @@ void KinectApp::loadShaders()
 	// Use transform shader by default
 	mShader = mShaderTransform;
     
+	// Load the strip shaders. The app runs without them if 
+	// they don't compile. Primitive restart is used when 
+	// it's available.
+	try
+	{
+		if (mGlslVersion >= 1.5)
+		{
+			mNormalShader = gl::GlslProg(loadResource(RES_SHADER_NORMAL_VERT_150), loadResource(RES_SHADER_NORMAL_FRAG_150));
+			mStripShader = gl::GlslProg(loadResource(RES_SHADER_STRIP_VERT_150), loadResource(RES_SHADER_FRAG_150));
+		}
+		else
+		{
+			mNormalShader = gl::GlslProg(loadResource(RES_SHADER_NORMAL_VERT_120), loadResource(RES_SHADER_NORMAL_FRAG_120));
+			mStripShader = gl::GlslProg(loadResource(RES_SHADER_STRIP_VERT_120), loadResource(RES_SHADER_FRAG_120));
+		}
+		mStripRestart = gl::isExtensionAvailable("GL_NV_primitive_restart");
+	}
+	catch (gl::GlslProgCompileExc & ex)
+	{
+		trace("Triangle strips not available.");
+		trace(ex.what());
+	}
+	catch (...)
+	{
+		trace("Triangle strips not available.");
+	}
+    
 }
 
 void KinectApp::subtractBackground()